@@ -0,0 +1,272 @@
+/** @file bench.c
+ *
+ *  @brief Helpers shared by the benchmarks: timing, statistics and
+ *         generation of synthetic frames.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+/* @brief Number of allocations (malloc, calloc, realloc) since the start. */
+static uint64_t allocations;
+
+#ifdef __GLIBC__
+/* The allocator is interposed to count the allocations, including the ones
+ * done in cairo, pango and glib. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+#endif
+
+uint64_t bench_allocations(void) {
+  return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
+
+/* @brief Growable string used to build a frame. */
+typedef struct {
+  char *data;
+  size_t length;
+  size_t size;
+} strbuf_t;
+
+static void strbuf_putc(strbuf_t *buf, char c) {
+  if (buf->length + 2 > buf->size) {
+    buf->size = buf->size ? buf->size * 2 : 256;
+    buf->data = realloc(buf->data, buf->size);
+    if (!buf->data) {
+      fprintf(stderr, "Out of memory.\n");
+      exit(1);
+    }
+  }
+  buf->data[buf->length++] = c;
+  buf->data[buf->length] = '\0';
+}
+
+static void strbuf_puts(strbuf_t *buf, const char *s) {
+  while (*s) {
+    strbuf_putc(buf, *s++);
+  }
+}
+
+/* @brief xorshift64*, good enough and reproducible everywhere. */
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+static double next_probability(uint64_t *state) {
+  return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+uint64_t bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void frame_spec_default(frame_spec_t *spec) {
+  spec->results = 100;
+  spec->text_size = 40;
+  spec->desc_size = 0;
+  spec->escape_density = 0.01;
+  spec->markup_density = 0.1;
+  spec->image_density = 0.0;
+  spec->image_path = "/usr/share/pixmaps/debian-logo.png";
+  spec->seed = 42;
+}
+
+int32_t frame_spec_option(frame_spec_t *spec, int opt, const char *arg) {
+  switch (opt) {
+    case 'n':
+      spec->results = strtoul(arg, NULL, 10);
+      break;
+    case 's':
+      spec->text_size = strtoul(arg, NULL, 10);
+      break;
+    case 'd':
+      spec->desc_size = strtoul(arg, NULL, 10);
+      break;
+    case 'e':
+      spec->escape_density = strtod(arg, NULL);
+      break;
+    case 'm':
+      spec->markup_density = strtod(arg, NULL);
+      break;
+    case 'g':
+      spec->image_density = strtod(arg, NULL);
+      break;
+    case 'p':
+      spec->image_path = arg;
+      break;
+    case 'S':
+      spec->seed = strtoull(arg, NULL, 10);
+      break;
+    default:
+      return 0;
+  }
+  return 1;
+}
+
+/* @brief Appends about "size" bytes of words to the buffer.
+ *
+ * @param in_desc 1 if the text is a description (%N and %L are allowed).
+ */
+static void generate_text(strbuf_t *buf, const frame_spec_t *spec, uint32_t size, int32_t in_desc, uint64_t *state) {
+  static const char *escapes[] = { "\\{", "\\|", "\\}", "\\\\", "\\%" };
+  size_t start = buf->length;
+  while (buf->length - start < size) {
+    uint32_t word_length = 2 + next_random(state) % 8;
+    int32_t markup = next_probability(state) < spec->markup_density;
+    if (markup) {
+      strbuf_puts(buf, (next_random(state) & 1) ? "%B" : "%C");
+    }
+    for (uint32_t i = 0; i < word_length; i++) {
+      if (next_probability(state) < spec->escape_density) {
+        strbuf_puts(buf, escapes[next_random(state) % (sizeof(escapes) / sizeof(escapes[0]))]);
+      } else {
+        strbuf_putc(buf, 'a' + next_random(state) % 26);
+      }
+    }
+    if (markup) {
+      strbuf_putc(buf, '%');
+    }
+    if (in_desc && next_probability(state) < 0.1) {
+      strbuf_puts(buf, (next_random(state) & 1) ? "%N" : "%L");
+    } else {
+      strbuf_putc(buf, ' ');
+    }
+  }
+}
+
+char *generate_frame(const frame_spec_t *spec, size_t *length) {
+  strbuf_t buf = { NULL, 0, 0 };
+  uint64_t state = spec->seed ? spec->seed : 1;
+
+  for (uint32_t i = 0; i < spec->results; i++) {
+    strbuf_putc(&buf, '{');
+    if (next_probability(&state) < spec->image_density) {
+      strbuf_puts(&buf, "%I");
+      strbuf_puts(&buf, spec->image_path);
+      strbuf_putc(&buf, '%');
+    }
+    generate_text(&buf, spec, spec->text_size, 0, &state);
+    strbuf_puts(&buf, "|xdg-open ");
+    generate_text(&buf, spec, 16, 0, &state);
+    if (spec->desc_size) {
+      strbuf_putc(&buf, '|');
+      generate_text(&buf, spec, spec->desc_size, 1, &state);
+    }
+    strbuf_putc(&buf, '}');
+  }
+  strbuf_putc(&buf, '\n');
+
+  *length = buf.length;
+  return buf.data;
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+void bench_summarize(double *samples, uint32_t n, bench_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  if (!n) {
+    return;
+  }
+  qsort(samples, n, sizeof(samples[0]), compare_double);
+  stats->min = samples[0];
+  stats->median = (n % 2) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+  for (uint32_t i = 0; i < n; i++) {
+    stats->mean += samples[i];
+  }
+  stats->mean /= n;
+  for (uint32_t i = 0; i < n; i++) {
+    stats->stddev += (samples[i] - stats->mean) * (samples[i] - stats->mean);
+  }
+  stats->stddev = n > 1 ? sqrt(stats->stddev / (n - 1)) : 0;
+}
+
+void bench_print_header(void) {
+  printf("%-36s %12s %12s %8s %10s %12s %10s\n",
+         "benchmark", "median ns", "min ns", "+-%", "MB/s", "items/s", "allocs");
+}
+
+double bench_run(const char *name, bench_fn_t fn, void *ctx, double bytes, double items, const bench_options_t *options, bench_stats_t *stats) {
+  uint64_t iterations = 1;
+  uint64_t target = options->target_ms * 1000000;
+
+  /* Calibration, also used as a warmup. */
+  while (1) {
+    uint64_t begin = bench_now();
+    fn(ctx, iterations);
+    uint64_t elapsed = bench_now() - begin;
+    if (elapsed >= target || iterations >= (1ULL << 40)) {
+      break;
+    }
+    iterations *= (elapsed < target / 16) ? 8 : 2;
+  }
+
+  double *samples = calloc(options->repetitions, sizeof(double));
+  if (!samples) {
+    fprintf(stderr, "Out of memory.\n");
+    exit(1);
+  }
+  uint64_t allocations_begin = bench_allocations();
+  for (uint32_t i = 0; i < options->repetitions; i++) {
+    uint64_t begin = bench_now();
+    fn(ctx, iterations);
+    samples[i] = (double)(bench_now() - begin) / iterations;
+  }
+  double allocations_per_call = (double)(bench_allocations() - allocations_begin)
+      / ((double)options->repetitions * iterations);
+
+  bench_stats_t result;
+  bench_summarize(samples, options->repetitions, &result);
+  free(samples);
+
+  double spread = result.mean ? 100 * result.stddev / result.mean : 0;
+  printf("%-36s %12.1f %12.1f %8.2f", name, result.median, result.min, spread);
+  if (bytes && result.median) {
+    printf(" %10.1f", bytes * 1000 / result.median);
+  } else {
+    printf(" %10s", "-");
+  }
+  if (items && result.median) {
+    printf(" %12.0f", items * 1e9 / result.median);
+  } else {
+    printf(" %12s", "-");
+  }
+  printf(" %10.2f\n", allocations_per_call);
+  fflush(stdout);
+
+  if (stats) {
+    *stats = result;
+  }
+  return allocations_per_call;
+}
@@ -0,0 +1,86 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* @brief Description of a synthetic frame, as a backend would print it. */
+typedef struct {
+  uint32_t results;       /* Number of results in the frame. */
+  uint32_t text_size;     /* Approximate size in bytes of a title. */
+  uint32_t desc_size;     /* Approximate size in bytes of a description (0 for none). */
+  double escape_density;  /* Probability for a character to be an escape sequence. */
+  double markup_density;  /* Probability for a word to be wrapped in %B or %C. */
+  double image_density;   /* Probability for a title to start with an %I image. */
+  const char *image_path; /* Image used by the %I sequences. */
+  uint64_t seed;          /* Seed of the generator, same seed gives the same frame. */
+} frame_spec_t;
+
+/* @brief Statistics computed over the repetitions of a benchmark. */
+typedef struct {
+  double min;
+  double median;
+  double mean;
+  double stddev;
+} bench_stats_t;
+
+/* @brief Function benchmarked by bench_run, it must do "iterations" calls. */
+typedef void (*bench_fn_t)(void *ctx, uint64_t iterations);
+
+/* @brief Options shared by every benchmark. */
+typedef struct {
+  uint32_t repetitions; /* Number of measured repetitions. */
+  double target_ms;     /* Minimal duration of one repetition. */
+} bench_options_t;
+
+/* @brief Returns a monotonic time in nanoseconds. */
+uint64_t bench_now(void);
+
+/* @brief Fills the spec with the default values (small launcher like frame). */
+void frame_spec_default(frame_spec_t *spec);
+
+/* @brief Parses a frame option (-n, -s, -d, -e, -m, -g, -p, -S).
+ *
+ * @return 1 if the option was recognized, else 0.
+ */
+int32_t frame_spec_option(frame_spec_t *spec, int opt, const char *arg);
+
+/* @brief Generates a frame following the spec, terminated by '\n' and '\0'.
+ *
+ * note: An allocation is done in this function, so the frame should be freed.
+ *
+ * @param spec Description of the frame.
+ * @param length A reference to the length of the frame (without the '\0').
+ * @return The frame.
+ */
+char *generate_frame(const frame_spec_t *spec, size_t *length);
+
+/* @brief Runs fn until the result are stable and prints a line of report.
+ *
+ * The number of iterations per repetition is calibrated so that a repetition
+ * lasts at least options->target_ms, then options->repetitions repetitions are
+ * measured after a warmup one.
+ *
+ * @param name Name printed in the report.
+ * @param fn The benchmarked function.
+ * @param ctx Passed to fn.
+ * @param bytes Bytes processed by a call (0 to skip the throughput).
+ * @param items Items processed by a call (0 to skip the rate).
+ * @param options Repetition options.
+ * @param stats If not NULL, filled with the per-call statistics in ns.
+ * @return The number of allocations per call.
+ */
+double bench_run(const char *name, bench_fn_t fn, void *ctx, double bytes, double items, const bench_options_t *options, bench_stats_t *stats);
+
+/* @brief Returns the number of allocations done by the process so far
+ *        (always 0 when the allocator can't be interposed).
+ */
+uint64_t bench_allocations(void);
+
+/* @brief Computes the statistics over n samples (the samples are sorted). */
+void bench_summarize(double *samples, uint32_t n, bench_stats_t *stats);
+
+/* @brief Prints the header of the report. */
+void bench_print_header(void);
+
+#endif /* _BENCH_H */
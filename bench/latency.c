@@ -0,0 +1,348 @@
+/** @file latency.c
+ *
+ *  @brief Keystroke to pixels latency of a running lighthouse.
+ *
+ *  Types queries into the lighthouse window with XTEST fake key events and
+ *  watches the window with XDamage: a keystroke is done when the damage
+ *  reaches the bottom of the last expected row. The rows can be read back
+ *  (-V) to check that something was really painted there.
+ *
+ *  Meant to run against Xvfb, see latency.sh which sets everything up.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <xcb/damage.h>
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+
+#include "bench.h"
+
+#define XK_SHIFT_L   0xffe1
+#define XK_BACKSPACE 0xff08
+
+/* @brief State of the harness. */
+struct harness_s {
+  xcb_connection_t *connection;
+  xcb_screen_t *screen;
+  xcb_window_t window;
+  uint8_t damage_event;
+  xcb_keycode_t min_keycode;
+  uint8_t keysyms_per_keycode;
+  xcb_keysym_t *keysyms;
+  uint32_t keysyms_length;
+  uint32_t row_height;  /* settings.height of lighthouse. */
+  uint32_t rows;        /* Rows expected after each keystroke. */
+  uint32_t timeout_ms;
+  uint32_t delay_ms;    /* Delay between two keystrokes. */
+  int32_t verify;
+  double *samples;
+  uint32_t sample_count;
+  uint32_t misses;
+  uint32_t blank_rows;
+};
+
+static void sleep_ms(uint32_t ms) {
+  struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+/* @brief Looks for the top level window named "lighthouse". */
+static xcb_window_t find_lighthouse(struct harness_s *h) {
+  xcb_window_t found = XCB_NONE;
+  xcb_query_tree_reply_t *tree = xcb_query_tree_reply(h->connection, xcb_query_tree(h->connection, h->screen->root), NULL);
+  if (!tree) {
+    return XCB_NONE;
+  }
+  xcb_window_t *children = xcb_query_tree_children(tree);
+  for (int i = 0; i < xcb_query_tree_children_length(tree) && found == XCB_NONE; i++) {
+    xcb_get_property_reply_t *name = xcb_get_property_reply(h->connection,
+        xcb_get_property(h->connection, 0, children[i], XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 0, 64), NULL);
+    if (name) {
+      if (xcb_get_property_value_length(name) == strlen("lighthouse")
+          && !memcmp(xcb_get_property_value(name), "lighthouse", strlen("lighthouse"))) {
+        found = children[i];
+      }
+      free(name);
+    }
+  }
+  free(tree);
+  return found;
+}
+
+/* @brief Finds the keycode of a keysym, *shift is set if shift is needed. */
+static xcb_keycode_t keycode_of(struct harness_s *h, xcb_keysym_t keysym, int32_t *shift) {
+  for (uint32_t i = 0; i < h->keysyms_length; i++) {
+    if (h->keysyms[i] == keysym) {
+      *shift = (i % h->keysyms_per_keycode) == 1;
+      if ((i % h->keysyms_per_keycode) <= 1) {
+        return h->min_keycode + i / h->keysyms_per_keycode;
+      }
+    }
+  }
+  return 0;
+}
+
+static void fake_key(struct harness_s *h, uint8_t type, xcb_keycode_t keycode) {
+  xcb_test_fake_input(h->connection, type, keycode, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+}
+
+/* @brief Types a keysym. lighthouse reacts on the release, which is flushed last. */
+static int32_t type_keysym(struct harness_s *h, xcb_keysym_t keysym) {
+  int32_t shift = 0;
+  xcb_keycode_t keycode = keycode_of(h, keysym, &shift);
+  if (!keycode) {
+    fprintf(stderr, "No keycode for keysym 0x%x, skipped.\n", keysym);
+    return 1;
+  }
+  xcb_keycode_t shift_keycode = 0;
+  if (shift) {
+    int32_t unused;
+    shift_keycode = keycode_of(h, XK_SHIFT_L, &unused);
+    fake_key(h, XCB_KEY_PRESS, shift_keycode);
+  }
+  fake_key(h, XCB_KEY_PRESS, keycode);
+  fake_key(h, XCB_KEY_RELEASE, keycode);
+  if (shift) {
+    fake_key(h, XCB_KEY_RELEASE, shift_keycode);
+  }
+  xcb_flush(h->connection);
+  return 0;
+}
+
+/* @brief Drops the events already queued (damage of the previous keystroke). */
+static void drain_events(struct harness_s *h) {
+  xcb_generic_event_t *event;
+  while ((event = xcb_poll_for_event(h->connection))) {
+    free(event);
+  }
+}
+
+/* @brief Checks that the last expected row isn't a plain background. */
+static int32_t row_is_painted(struct harness_s *h) {
+  uint32_t y = h->rows * h->row_height;
+  xcb_get_geometry_reply_t *geometry = xcb_get_geometry_reply(h->connection, xcb_get_geometry(h->connection, h->window), NULL);
+  if (!geometry) {
+    return 0;
+  }
+  uint16_t width = geometry->width;
+  free(geometry);
+  xcb_get_image_reply_t *image = xcb_get_image_reply(h->connection,
+      xcb_get_image(h->connection, XCB_IMAGE_FORMAT_Z_PIXMAP, h->window, 0, y, width, h->row_height, ~0), NULL);
+  if (!image) {
+    return 0;
+  }
+  uint32_t *pixels = (uint32_t *)xcb_get_image_data(image);
+  uint32_t count = xcb_get_image_data_length(image) / 4;
+  int32_t painted = 0;
+  for (uint32_t i = 1; i < count && !painted; i++) {
+    painted = (pixels[i] & 0xffffff) != (pixels[0] & 0xffffff);
+  }
+  free(image);
+  return painted;
+}
+
+/* @brief Waits until the damage covers the expected rows.
+ *
+ * @return The latency in ns, or 0 on timeout.
+ */
+static uint64_t wait_for_rows(struct harness_s *h, uint64_t begin) {
+  uint32_t bottom = (h->rows + 1) * h->row_height;
+  uint64_t deadline = begin + (uint64_t)h->timeout_ms * 1000000;
+  while (1) {
+    xcb_generic_event_t *event;
+    while ((event = xcb_poll_for_event(h->connection))) {
+      uint64_t now = bench_now();
+      if ((event->response_type & ~0x80) == h->damage_event + XCB_DAMAGE_NOTIFY) {
+        xcb_damage_notify_event_t *damage = (xcb_damage_notify_event_t *)event;
+        if (damage->area.y + damage->area.height >= bottom) {
+          free(event);
+          return now - begin;
+        }
+      }
+      free(event);
+    }
+    if (xcb_connection_has_error(h->connection)) {
+      return 0;
+    }
+    uint64_t now = bench_now();
+    if (now >= deadline) {
+      return 0;
+    }
+    struct pollfd pfd = { xcb_get_file_descriptor(h->connection), POLLIN, 0 };
+    poll(&pfd, 1, (deadline - now) / 1000000 + 1);
+  }
+}
+
+static void measure_keysym(struct harness_s *h, xcb_keysym_t keysym) {
+  drain_events(h);
+  uint64_t begin = bench_now();
+  if (type_keysym(h, keysym)) {
+    return;
+  }
+  uint64_t latency = wait_for_rows(h, begin);
+  if (!latency) {
+    h->misses++;
+  } else {
+    h->samples[h->sample_count++] = latency / 1e6;
+    if (h->verify && !row_is_painted(h)) {
+      h->blank_rows++;
+    }
+  }
+  sleep_ms(h->delay_ms);
+}
+
+/* @brief Types a query then erases it, measuring every keystroke. */
+static void run_query(struct harness_s *h, const char *query) {
+  size_t length = strlen(query);
+  h->samples = realloc(h->samples, (h->sample_count + 2 * length) * sizeof(double));
+  for (size_t i = 0; i < length; i++) {
+    measure_keysym(h, (unsigned char)query[i]);
+  }
+  for (size_t i = 0; i < length; i++) {
+    measure_keysym(h, XK_BACKSPACE);
+  }
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options] [query...]\n"
+          "  -f file      read the queries from a file, one per line\n"
+          "  -r rows      rows expected after each keystroke (6)\n"
+          "  -H pixels    height of a row, height= in lighthouserc (30)\n"
+          "  -t ms        timeout of a keystroke (2000)\n"
+          "  -d ms        delay between keystrokes (50)\n"
+          "  -w ms        how long to wait for the window (5000)\n"
+          "  -V           read the last row back to check it is painted\n"
+          "Runs against $DISPLAY, lighthouse must set backspace_exit=0.\n",
+          name);
+}
+
+int main(int argc, char **argv) {
+  struct harness_s h;
+  memset(&h, 0, sizeof(h));
+  h.row_height = 30;
+  h.rows = 6;
+  h.timeout_ms = 2000;
+  h.delay_ms = 50;
+  uint32_t wait_ms = 5000;
+  const char *query_file = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:r:H:t:d:w:Vh")) != -1) {
+    switch (opt) {
+      case 'f':
+        query_file = optarg;
+        break;
+      case 'r':
+        h.rows = strtoul(optarg, NULL, 10);
+        break;
+      case 'H':
+        h.row_height = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        h.timeout_ms = strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        h.delay_ms = strtoul(optarg, NULL, 10);
+        break;
+      case 'w':
+        wait_ms = strtoul(optarg, NULL, 10);
+        break;
+      case 'V':
+        h.verify = 1;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  h.connection = xcb_connect(NULL, NULL);
+  if (xcb_connection_has_error(h.connection)) {
+    fprintf(stderr, "Couldn't connect to the X server.\n");
+    return 1;
+  }
+  h.screen = xcb_setup_roots_iterator(xcb_get_setup(h.connection)).data;
+
+  const xcb_query_extension_reply_t *damage = xcb_get_extension_data(h.connection, &xcb_damage_id);
+  const xcb_query_extension_reply_t *xtest = xcb_get_extension_data(h.connection, &xcb_test_id);
+  if (!damage || !damage->present || !xtest || !xtest->present) {
+    fprintf(stderr, "The X server needs the DAMAGE and XTEST extensions.\n");
+    return 1;
+  }
+  h.damage_event = damage->first_event;
+  free(xcb_damage_query_version_reply(h.connection, xcb_damage_query_version(h.connection, 1, 1), NULL));
+
+  /* Keyboard mapping, to type the queries. */
+  const xcb_setup_t *setup = xcb_get_setup(h.connection);
+  h.min_keycode = setup->min_keycode;
+  xcb_get_keyboard_mapping_reply_t *mapping = xcb_get_keyboard_mapping_reply(h.connection,
+      xcb_get_keyboard_mapping(h.connection, setup->min_keycode, setup->max_keycode - setup->min_keycode + 1), NULL);
+  if (!mapping) {
+    fprintf(stderr, "Couldn't get the keyboard mapping.\n");
+    return 1;
+  }
+  h.keysyms_per_keycode = mapping->keysyms_per_keycode;
+  h.keysyms = xcb_get_keyboard_mapping_keysyms(mapping);
+  h.keysyms_length = xcb_get_keyboard_mapping_keysyms_length(mapping);
+
+  uint64_t deadline = bench_now() + (uint64_t)wait_ms * 1000000;
+  while ((h.window = find_lighthouse(&h)) == XCB_NONE) {
+    if (bench_now() > deadline) {
+      fprintf(stderr, "No lighthouse window found.\n");
+      return 1;
+    }
+    sleep_ms(20);
+  }
+  xcb_damage_damage_t damage_id = xcb_generate_id(h.connection);
+  xcb_damage_create(h.connection, damage_id, h.window, XCB_DAMAGE_REPORT_LEVEL_RAW_RECTANGLES);
+  xcb_flush(h.connection);
+  /* Let lighthouse grab the focus and draw its first frame. */
+  sleep_ms(200);
+
+  if (query_file) {
+    FILE *file = fopen(query_file, "r");
+    if (!file) {
+      fprintf(stderr, "Couldn't open %s.\n", query_file);
+      return 1;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+      line[strcspn(line, "\n")] = '\0';
+      if (*line) {
+        run_query(&h, line);
+      }
+    }
+    fclose(file);
+  }
+  for (int i = optind; i < argc; i++) {
+    run_query(&h, argv[i]);
+  }
+
+  bench_stats_t stats;
+  uint32_t count = h.sample_count;
+  bench_summarize(h.samples, count, &stats);
+  printf("keystrokes: %u measured, %u timed out", count, h.misses);
+  if (h.verify) {
+    printf(", %u with a blank last row", h.blank_rows);
+  }
+  printf("\n");
+  if (count) {
+    printf("keystroke to pixels (ms): min %.2f median %.2f p90 %.2f p99 %.2f max %.2f mean %.2f +- %.2f\n",
+           stats.min, stats.median, h.samples[count * 90 / 100], h.samples[count * 99 / 100],
+           h.samples[count - 1], stats.mean, stats.stddev);
+  }
+
+  free(h.samples);
+  free(mapping);
+  xcb_disconnect(h.connection);
+  return h.misses ? 2 : 0;
+}
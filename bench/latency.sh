@@ -0,0 +1,96 @@
+#!/bin/sh
+# Measures the keystroke to pixels latency of lighthouse on a private Xvfb.
+#
+# usage: bench/latency.sh [-c cmd] [-s display] [latency options] [query...]
+#
+#   -c cmd      backend to run (default: bench/loadgen -n 100)
+#   -s display  display number for Xvfb (default: first free from 90)
+#
+# The other options and the queries are passed to bench/latency, see
+# bench/latency -h. Run from the top of the source tree after make bench.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+CMD="$ROOT/bench/loadgen -n 100"
+DISPLAY_NUMBER=
+
+while getopts "c:s:f:r:H:t:d:w:V" opt; do
+  case $opt in
+    c) CMD=$OPTARG ;;
+    s) DISPLAY_NUMBER=$OPTARG ;;
+    f) LATENCY_ARGS="$LATENCY_ARGS -f $OPTARG" ;;
+    r) LATENCY_ARGS="$LATENCY_ARGS -r $OPTARG" ;;
+    H) LATENCY_ARGS="$LATENCY_ARGS -H $OPTARG"; HEIGHT=$OPTARG ;;
+    t) LATENCY_ARGS="$LATENCY_ARGS -t $OPTARG" ;;
+    d) LATENCY_ARGS="$LATENCY_ARGS -d $OPTARG" ;;
+    w) LATENCY_ARGS="$LATENCY_ARGS -w $OPTARG" ;;
+    V) LATENCY_ARGS="$LATENCY_ARGS -V" ;;
+    *) exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 0 ] && [ -z "$(echo "$LATENCY_ARGS" | grep -- -f)" ] && set -- "hello world" "firefox"
+
+for bin in "$ROOT/lighthouse" "$ROOT/bench/latency"; do
+  if [ ! -x "$bin" ]; then
+    echo "$bin is missing, run make and make bench." >&2
+    exit 1
+  fi
+done
+if ! command -v Xvfb > /dev/null; then
+  echo "Xvfb is missing." >&2
+  exit 1
+fi
+
+if [ -z "$DISPLAY_NUMBER" ]; then
+  DISPLAY_NUMBER=90
+  while [ -e "/tmp/.X11-unix/X$DISPLAY_NUMBER" ] || [ -e "/tmp/.X$DISPLAY_NUMBER-lock" ]; do
+    DISPLAY_NUMBER=$((DISPLAY_NUMBER + 1))
+  done
+fi
+
+TMP=$(mktemp -d)
+XVFB_PID=
+LIGHTHOUSE_PID=
+cleanup() {
+  [ -n "$LIGHTHOUSE_PID" ] && kill "$LIGHTHOUSE_PID" 2> /dev/null
+  [ -n "$XVFB_PID" ] && kill "$XVFB_PID" 2> /dev/null
+  rm -rf "$TMP"
+}
+trap cleanup EXIT INT TERM
+
+Xvfb ":$DISPLAY_NUMBER" -screen 0 1280x800x24 -nolisten tcp > "$TMP/xvfb.log" 2>&1 &
+XVFB_PID=$!
+i=0
+while [ ! -e "/tmp/.X11-unix/X$DISPLAY_NUMBER" ]; do
+  i=$((i + 1))
+  if [ $i -gt 100 ] || ! kill -0 "$XVFB_PID" 2> /dev/null; then
+    echo "Xvfb didn't start:" >&2
+    cat "$TMP/xvfb.log" >&2
+    exit 1
+  fi
+  sleep 0.05
+done
+export DISPLAY=":$DISPLAY_NUMBER"
+
+# lighthouse only expands the first word of cmd=, the arguments go after --.
+CMD_BIN=${CMD%% *}
+CMD_ARGS=${CMD#"$CMD_BIN"}
+
+cat > "$TMP/lighthouserc" << EOF
+font_name=monospace
+font_size=18
+height=${HEIGHT:-30}
+cmd=$CMD_BIN
+backspace_exit=0
+EOF
+
+"$ROOT/lighthouse" -c "$TMP/lighthouserc" -- $CMD_ARGS > /dev/null 2> "$TMP/lighthouse.log" &
+LIGHTHOUSE_PID=$!
+
+"$ROOT/bench/latency" $LATENCY_ARGS "$@"
+STATUS=$?
+if [ $STATUS -ne 0 ] && [ -s "$TMP/lighthouse.log" ]; then
+  echo "lighthouse stderr:" >&2
+  cat "$TMP/lighthouse.log" >&2
+fi
+exit $STATUS
@@ -0,0 +1,301 @@
+/** @file loadgen.c
+ *
+ *  @brief A fake cmd generating synthetic frames, to stress the streaming
+ *         reader, the parser and the renderer without a real backend.
+ *
+ *  Point cmd= in a lighthouserc to it, for example:
+ *
+ *      cmd=/path/to/bench/loadgen -n 500 -m 0.3 -l 20 -M drip
+ *
+ *  Modes:
+ *      reply   one frame per query (default).
+ *      burst   -b frames per query, written back to back.
+ *      drip    one frame per query, written by chunks of -c bytes every -i ms.
+ *      stream  a frame every 1/-R seconds, whether a query came or not.
+ *
+ *  With -u it is a backend on a socket (see cmd_launch) rather than a piped
+ *  cmd: it listens on $LIGHTHOUSE_SOCKET and serves a lighthouse at a time,
+ *  until it is killed.
+ *
+ *      cmd=unix:~/.cache/lighthouse.sock
+ *      cmd_launch=/path/to/bench/loadgen -u -n 500
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+typedef enum {
+  MODE_REPLY,
+  MODE_BURST,
+  MODE_DRIP,
+  MODE_STREAM
+} loadgen_mode_t;
+
+/* @brief Options of the generator. */
+struct loadgen_s {
+  frame_spec_t spec;
+  loadgen_mode_t mode;
+  uint32_t latency_ms;  /* Delay before answering a query. */
+  double rate;          /* Frames per second in stream mode. */
+  uint32_t burst;       /* Frames per query in burst mode. */
+  uint32_t chunk;       /* Bytes per write in drip mode. */
+  uint32_t interval_ms; /* Delay between two writes in drip mode. */
+  int32_t verbose;
+  uint64_t frames;      /* Frames written so far. */
+  int32_t in;           /* Where queries are read. */
+  int32_t out;          /* Where frames are written. */
+  int32_t closed;       /* Set when lighthouse is gone. */
+};
+
+static void sleep_ms(uint32_t ms) {
+  struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+/* @brief Writes everything, or sets gen->closed if lighthouse is gone. */
+static void write_all(struct loadgen_s *gen, const char *data, size_t length) {
+  while (length && !gen->closed) {
+    ssize_t ret = write(gen->out, data, length);
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      gen->closed = 1;
+      return;
+    }
+    data += ret;
+    length -= ret;
+  }
+}
+
+/* @brief Generates and writes a frame, each frame gets its own seed. */
+static void emit_frame(struct loadgen_s *gen) {
+  frame_spec_t spec = gen->spec;
+  spec.seed += gen->frames;
+
+  size_t length;
+  char *frame = generate_frame(&spec, &length);
+  uint64_t begin = bench_now();
+  if (gen->mode == MODE_DRIP && gen->chunk) {
+    for (size_t done = 0; done < length && !gen->closed; done += gen->chunk) {
+      size_t size = length - done < gen->chunk ? length - done : gen->chunk;
+      write_all(gen, frame + done, size);
+      if (done + size < length) {
+        sleep_ms(gen->interval_ms);
+      }
+    }
+  } else {
+    write_all(gen, frame, length);
+  }
+  gen->frames++;
+  if (gen->verbose) {
+    fprintf(stderr, "loadgen: frame %llu, %u results, %zu bytes, written in %.3f ms\n",
+            (unsigned long long)gen->frames, spec.results, length, (bench_now() - begin) / 1e6);
+  }
+  free(frame);
+}
+
+static void answer_query(struct loadgen_s *gen) {
+  if (gen->latency_ms) {
+    sleep_ms(gen->latency_ms);
+  }
+  uint32_t count = gen->mode == MODE_BURST ? gen->burst : 1;
+  for (uint32_t i = 0; i < count && !gen->closed; i++) {
+    emit_frame(gen);
+  }
+}
+
+/* @brief Answers the queries of a lighthouse until it is gone. */
+static void serve(struct loadgen_s *gen) {
+  /* Queries are read with read() and split by hand, stdio buffering
+   * would hide pending lines from poll(). */
+  char line[4096];
+  size_t line_length = 0;
+  uint64_t period = gen->rate > 0 ? 1e9 / gen->rate : 1000000000ULL;
+  uint64_t next_frame = bench_now();
+
+  while (!gen->closed) {
+    int timeout = -1;
+    if (gen->mode == MODE_STREAM) {
+      uint64_t now = bench_now();
+      timeout = next_frame > now ? (next_frame - now) / 1000000 : 0;
+    }
+
+    struct pollfd pfd = { gen->in, POLLIN, 0 };
+    int ret = poll(&pfd, 1, timeout);
+    if (ret == -1 && errno != EINTR) {
+      return;
+    }
+
+    if (ret > 0) {
+      ssize_t size = read(gen->in, line + line_length, sizeof(line) - line_length);
+      if (size <= 0) {
+        return;
+      }
+      line_length += size;
+      char *newline;
+      while ((newline = memchr(line, '\n', line_length))) {
+        size_t consumed = newline - line + 1;
+        if (gen->mode != MODE_STREAM) {
+          answer_query(gen);
+        }
+        memmove(line, line + consumed, line_length - consumed);
+        line_length -= consumed;
+      }
+      if (line_length == sizeof(line)) {
+        /* A query too long for us, answer it anyway. */
+        line_length = 0;
+        if (gen->mode != MODE_STREAM) {
+          answer_query(gen);
+        }
+      }
+    }
+
+    if (gen->mode == MODE_STREAM && bench_now() >= next_frame) {
+      emit_frame(gen);
+      next_frame += period;
+    }
+  }
+}
+
+/* @brief Listens on $LIGHTHOUSE_SOCKET and serves the lighthouses that
+ *        connect, one after the other.
+ *
+ * @return 1 if the socket can't be listened on, else it doesn't return.
+ */
+static int listen_socket(struct loadgen_s *gen) {
+  const char *path = getenv("LIGHTHOUSE_SOCKET");
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (!path || strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "loadgen: -u needs LIGHTHOUSE_SOCKET, a socket path.\n");
+    return 1;
+  }
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  /* A socket left by a backend that was killed. */
+  unlink(path);
+  if (fd == -1 || bind(fd, (struct sockaddr *)&address, sizeof(address)) || listen(fd, 4)) {
+    fprintf(stderr, "loadgen: couldn't listen on %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  while (1) {
+    int connection = accept(fd, NULL, NULL);
+    if (connection == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      fprintf(stderr, "loadgen: accept failed: %s\n", strerror(errno));
+      return 1;
+    }
+    gen->in = gen->out = connection;
+    gen->closed = 0;
+    serve(gen);
+    close(connection);
+  }
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -n results   results per frame (100)\n"
+          "  -s bytes     size of a title (40)\n"
+          "  -d bytes     size of a description (0)\n"
+          "  -e density   probability of an escape per character (0.01)\n"
+          "  -m density   probability of markup per word (0.1)\n"
+          "  -g density   probability of an image per result (0)\n"
+          "  -p path      image used by %%I (%s)\n"
+          "  -S seed      seed of the generator (42)\n"
+          "  -M mode      reply, burst, drip or stream (reply)\n"
+          "  -l ms        latency before answering a query (0)\n"
+          "  -R rate      frames per second in stream mode (30)\n"
+          "  -b count     frames per query in burst mode (10)\n"
+          "  -c bytes     bytes per write in drip mode (64)\n"
+          "  -i ms        delay between writes in drip mode (5)\n"
+          "  -u           listen on the unix socket $LIGHTHOUSE_SOCKET\n"
+          "  -v           log every frame on stderr\n",
+          name, "/usr/share/pixmaps/debian-logo.png");
+}
+
+int main(int argc, char **argv) {
+  struct loadgen_s gen;
+  memset(&gen, 0, sizeof(gen));
+  frame_spec_default(&gen.spec);
+  gen.mode = MODE_REPLY;
+  gen.rate = 30;
+  gen.burst = 10;
+  gen.chunk = 64;
+  gen.interval_ms = 5;
+  int32_t listening = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:d:e:m:g:p:S:M:l:R:b:c:i:uvh")) != -1) {
+    if (frame_spec_option(&gen.spec, opt, optarg)) {
+      continue;
+    }
+    switch (opt) {
+      case 'M':
+        if (!strcmp(optarg, "reply")) {
+          gen.mode = MODE_REPLY;
+        } else if (!strcmp(optarg, "burst")) {
+          gen.mode = MODE_BURST;
+        } else if (!strcmp(optarg, "drip")) {
+          gen.mode = MODE_DRIP;
+        } else if (!strcmp(optarg, "stream")) {
+          gen.mode = MODE_STREAM;
+        } else {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'l':
+        gen.latency_ms = strtoul(optarg, NULL, 10);
+        break;
+      case 'R':
+        gen.rate = strtod(optarg, NULL);
+        break;
+      case 'b':
+        gen.burst = strtoul(optarg, NULL, 10);
+        break;
+      case 'c':
+        gen.chunk = strtoul(optarg, NULL, 10);
+        break;
+      case 'i':
+        gen.interval_ms = strtoul(optarg, NULL, 10);
+        break;
+      case 'u':
+        listening = 1;
+        break;
+      case 'v':
+        gen.verbose = 1;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  if (!listening) {
+    gen.in = STDIN_FILENO;
+    gen.out = STDOUT_FILENO;
+    serve(&gen);
+    return 0;
+  }
+  return listen_socket(&gen);
+}
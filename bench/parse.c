@@ -0,0 +1,291 @@
+/** @file parse.c
+ *
+ *  @brief Microbenchmarks of the result parsing: parse_result_text (and
+ *         parse_result_jsonl on the same results) then intern_results on
+ *         whole frames, as get_results does, parse_result_line (and so
+ *         get_characters) on each row, and the measurement of the query
+ *         line.
+ *
+ *  Built both with pango and with NO_PANGO by `make bench`, run with -h
+ *  for the options.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "display.h"
+#include "globals.h"
+#include "jsonl.h"
+#include "results.h"
+
+/* @brief Context of the frame benchmarks. */
+struct frame_ctx {
+  char *frame;
+  size_t length;
+  char *work;
+};
+
+/* @brief Context of the row and query benchmarks. */
+struct line_ctx {
+  cairo_t *cr;
+  cairo_surface_t *surface;
+  char *base;
+  result_t *results;
+  uint32_t count;
+  uint32_t line_width;
+  char *query;
+  uint32_t cursor;
+#ifndef NO_PANGO
+  PangoFontDescription *font_description;
+#endif
+};
+
+static void bench_copy(void *arg, uint64_t iterations) {
+  struct frame_ctx *ctx = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    memcpy(ctx->work, ctx->frame, ctx->length + 1);
+  }
+}
+
+static void bench_parse_result_text(void *arg, uint64_t iterations) {
+  struct frame_ctx *ctx = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    memcpy(ctx->work, ctx->frame, ctx->length + 1);
+    result_t *results = NULL;
+    uint32_t count = parse_result_text(ctx->work, ctx->length, &results);
+    intern_results(ctx->work, ctx->length, results, count);
+    free(results);
+  }
+}
+
+static void bench_parse_result_jsonl(void *arg, uint64_t iterations) {
+  struct frame_ctx *ctx = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    memcpy(ctx->work, ctx->frame, ctx->length + 1);
+    result_t *results = NULL;
+    uint32_t count = parse_result_jsonl(ctx->work, ctx->length, &results);
+    intern_results(ctx->work, ctx->length, results, count);
+    free(results);
+  }
+}
+
+/* @brief Appends a JSON string, escaped. */
+static char *append_json_string(char *out, const char *s) {
+  *out++ = '"';
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      *out++ = '\\';
+      *out++ = *s;
+    } else if ((unsigned char)*s < 0x20) {
+      out += sprintf(out, "\\u%04x", *s);
+    } else {
+      *out++ = *s;
+    }
+  }
+  *out++ = '"';
+  return out;
+}
+
+/* @brief Writes parsed results as a JSON Lines frame (see FORMAT_JSONL). */
+static char *generate_jsonl(char *base, result_t *results, uint32_t count, size_t *length) {
+  size_t size = 1;
+  for (uint32_t r = 0; r < count; r++) {
+    size += 40;
+    uint32_t fields[] = { results[r].text, results[r].action, results[r].desc };
+    for (uint32_t f = 0; f < 3; f++) {
+      if (fields[f] != NO_OFFSET) {
+        size += 6 * strlen(base + fields[f]);
+      }
+    }
+  }
+  char *frame = malloc(size);
+  if (!frame) {
+    return NULL;
+  }
+  char *out = frame;
+  for (uint32_t r = 0; r < count; r++) {
+    out += sprintf(out, "{\"text\":");
+    out = append_json_string(out, base + results[r].text);
+    if (results[r].action != NO_OFFSET) {
+      out += sprintf(out, ",\"action\":");
+      out = append_json_string(out, base + results[r].action);
+    }
+    if (results[r].desc != NO_OFFSET) {
+      out += sprintf(out, ",\"desc\":");
+      out = append_json_string(out, base + results[r].desc);
+    }
+    out += sprintf(out, "}\n");
+  }
+  *out = '\0';
+  *length = out - frame;
+  return frame;
+}
+
+static void bench_parse_result_line(void *arg, uint64_t iterations) {
+  struct line_ctx *ctx = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    for (uint32_t r = 0; r < ctx->count; r++) {
+      modifier_stack_t modifiers = { .length = 0 };
+      /* Same loop as draw_line, without the drawing. */
+      char *c = ctx->base + ctx->results[r].text;
+      while (c && *c != '\0') {
+#ifndef NO_PANGO
+        draw_t d = parse_result_line(ctx->cr, &c, ctx->line_width, &modifiers, ctx->font_description);
+#else
+        draw_t d = parse_result_line(ctx->cr, &c, ctx->line_width, &modifiers);
+#endif
+        if (d.data == NULL)
+          break;
+      }
+    }
+  }
+}
+
+static void bench_query(void *arg, uint64_t iterations) {
+  struct line_ctx *ctx = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    draw_query_text(ctx->cr, ctx->surface, ctx->query, ctx->cursor);
+  }
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -n results   results per frame (100)\n"
+          "  -s bytes     size of a title (40)\n"
+          "  -d bytes     size of a description (0)\n"
+          "  -e density   probability of an escape per character (0.01)\n"
+          "  -m density   probability of markup per word (0.1)\n"
+          "  -g density   probability of an image per result (0)\n"
+          "  -p path      image used by %%I (%s)\n"
+          "  -S seed      seed of the generator (42)\n"
+          "  -r count     measured repetitions (30)\n"
+          "  -t ms        minimal duration of a repetition (20)\n"
+          "  -w pixels    width of a line (500)\n",
+          name, "/usr/share/pixmaps/debian-logo.png");
+}
+
+int main(int argc, char **argv) {
+  frame_spec_t spec;
+  bench_options_t options = { 30, 20 };
+  frame_spec_default(&spec);
+  settings.width = 500;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:d:e:m:g:p:S:r:t:w:h")) != -1) {
+    if (frame_spec_option(&spec, opt, optarg)) {
+      continue;
+    }
+    switch (opt) {
+      case 'r':
+        options.repetitions = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        options.target_ms = strtod(optarg, NULL);
+        break;
+      case 'w':
+        settings.width = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  /* The settings used by the drawing functions. */
+  settings.font_name = "monospace";
+  settings.font_size = 18;
+  settings.height = 30;
+  settings.horiz_padding = 5;
+  settings.cursor_padding = 4;
+  settings.query_fg = settings.result_fg = (color_t){ 0.1, 0.1, 0.1 };
+  settings.query_bg = settings.result_bg = (color_t){ 1.0, 1.0, 1.0 };
+  pthread_mutex_init(&global.draw_mutex, NULL);
+  pthread_mutex_init(&global.result_mutex, NULL);
+
+  struct frame_ctx frame_ctx;
+  frame_ctx.frame = generate_frame(&spec, &frame_ctx.length);
+  frame_ctx.work = malloc(frame_ctx.length + 1);
+  if (!frame_ctx.work) {
+    return 1;
+  }
+
+#ifndef NO_PANGO
+  printf("variant: pango\n");
+#else
+  printf("variant: cairo (NO_PANGO)\n");
+#endif
+  printf("frame: %u results, %zu bytes, escapes %.3f, markup %.3f\n\n",
+         spec.results, frame_ctx.length, spec.escape_density, spec.markup_density);
+  bench_print_header();
+
+  bench_run("memcpy frame (baseline)", bench_copy, &frame_ctx, frame_ctx.length, 0, &options, NULL);
+  bench_run("parse_result_text", bench_parse_result_text, &frame_ctx, frame_ctx.length, spec.results, &options, NULL);
+
+  /* Keep a parsed copy of the frame for the row benchmarks. */
+  char *parsed = strdup(frame_ctx.frame);
+  struct line_ctx line_ctx;
+  line_ctx.base = parsed;
+  line_ctx.count = parse_result_text(parsed, frame_ctx.length, &line_ctx.results);
+  line_ctx.line_width = settings.width - settings.horiz_padding;
+  line_ctx.surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, settings.width, settings.height);
+  line_ctx.cr = cairo_create(line_ctx.surface);
+  cairo_select_font_face(line_ctx.cr, settings.font_name, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size(line_ctx.cr, settings.font_size);
+  cairo_font_extents_t extents;
+  cairo_font_extents(line_ctx.cr, &extents);
+  global.real_font_size = extents.height;
+#ifndef NO_PANGO
+  line_ctx.font_description = pango_font_description_new();
+  pango_font_description_set_family(line_ctx.font_description, settings.font_name);
+  pango_font_description_set_absolute_size(line_ctx.font_description, settings.font_size * PANGO_SCALE);
+#endif
+
+  /* The same results as JSON Lines. */
+  struct frame_ctx jsonl_ctx;
+  jsonl_ctx.frame = generate_jsonl(parsed, line_ctx.results, line_ctx.count, &jsonl_ctx.length);
+  jsonl_ctx.work = jsonl_ctx.frame ? malloc(jsonl_ctx.length + 1) : NULL;
+  if (jsonl_ctx.work) {
+    bench_run("parse_result_jsonl", bench_parse_result_jsonl, &jsonl_ctx, jsonl_ctx.length, line_ctx.count, &options, NULL);
+  }
+
+  size_t text_bytes = 0;
+  for (uint32_t r = 0; r < line_ctx.count; r++) {
+    text_bytes += strlen(parsed + line_ctx.results[r].text);
+  }
+  bench_run("parse_result_line (all rows)", bench_parse_result_line, &line_ctx, text_bytes, line_ctx.count, &options, NULL);
+
+  /* Query line: cursor at the end, as when typing. */
+  static const uint32_t query_lengths[] = { 8, 64, 512 };
+  for (uint32_t i = 0; i < sizeof(query_lengths) / sizeof(query_lengths[0]); i++) {
+    char name[64];
+    uint32_t length = query_lengths[i];
+    line_ctx.query = malloc(length + 1);
+    for (uint32_t j = 0; j < length; j++) {
+      line_ctx.query[j] = 'a' + j % 26;
+    }
+    line_ctx.query[length] = '\0';
+    line_ctx.cursor = length;
+    snprintf(name, sizeof(name), "draw_query_text (%u chars)", length);
+    bench_run(name, bench_query, &line_ctx, length, 1, &options, NULL);
+    free(line_ctx.query);
+  }
+
+#ifndef NO_PANGO
+  pango_font_description_free(line_ctx.font_description);
+#endif
+  cairo_destroy(line_ctx.cr);
+  cairo_surface_destroy(line_ctx.surface);
+  free(line_ctx.results);
+  free(parsed);
+  free(jsonl_ctx.frame);
+  free(jsonl_ctx.work);
+  free(frame_ctx.work);
+  free(frame_ctx.frame);
+  return 0;
+}
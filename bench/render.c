@@ -0,0 +1,227 @@
+/** @file render.c
+ *
+ *  @brief End to end benchmark of the rendering: draw_result_text and
+ *         redraw_all on an offscreen surface, for a few representative
+ *         workloads. Reports the frame time, the frames and rows per second
+ *         and the allocations per frame.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "display.h"
+#include "globals.h"
+#include "results.h"
+
+/* @brief Context of a workload. */
+struct render_ctx {
+  cairo_t *cr;
+  cairo_surface_t *surface;
+  char *frame;
+  result_t *results;
+  uint32_t count;
+  int32_t move_highlight;
+  char query[64];
+};
+
+static void bench_draw_result_text(void *arg, uint64_t iterations) {
+  struct render_ctx *ctx = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    if (ctx->move_highlight) {
+      /* Same as pressing Down, wrapping at the end. */
+      global.result_highlight = (global.result_highlight + 1) % ctx->count;
+    }
+    draw_result_text(NULL, 0, ctx->cr, ctx->surface, ctx->frame, ctx->results);
+  }
+}
+
+static void bench_redraw_all(void *arg, uint64_t iterations) {
+  struct render_ctx *ctx = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    redraw_all(NULL, 0, ctx->cr, ctx->surface, ctx->query, strlen(ctx->query));
+  }
+}
+
+/* @brief Parses the frame described by spec and makes it the current results. */
+static void load_frame(struct render_ctx *ctx, const frame_spec_t *spec) {
+  size_t length;
+  ctx->frame = generate_frame(spec, &length);
+  ctx->count = parse_result_text(ctx->frame, length, &ctx->results);
+  intern_results(ctx->frame, length, ctx->results, ctx->count);
+  global.results = global.frame_results = ctx->results;
+  global.result_base = ctx->frame;
+  global.result_count = global.frame_count = ctx->count;
+  global.result_highlight = 0;
+  global.result_offset = 0;
+}
+
+static void unload_frame(struct render_ctx *ctx) {
+  free(ctx->results);
+  free(ctx->frame);
+  global.results = global.frame_results = NULL;
+  global.result_count = global.frame_count = 0;
+}
+
+/* @brief Runs a workload and prints the summary line. */
+static void run_workload(const char *name, struct render_ctx *ctx, const frame_spec_t *spec, bench_fn_t fn, const bench_options_t *options) {
+  load_frame(ctx, spec);
+  uint32_t max_results = settings.max_height / settings.height - 1;
+  uint32_t rows = ctx->count < max_results ? ctx->count : max_results;
+
+  bench_stats_t stats;
+  double allocations = bench_run(name, fn, ctx, 0, rows, options, &stats);
+  if (stats.median) {
+    printf("    %.3f ms/frame, %.0f frames/s, %.0f rows/s, %.3f ms/row, %.1f allocs/frame\n",
+           stats.median / 1e6, 1e9 / stats.median, rows * 1e9 / stats.median,
+           stats.median / 1e6 / rows, allocations);
+  }
+  unload_frame(ctx);
+}
+
+/* @brief Writes a small png, used as the icon of the results. */
+static char *create_icon(void) {
+  static char path[] = "/tmp/lighthouse-bench-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    return NULL;
+  }
+  close(fd);
+  cairo_surface_t *icon = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 24, 24);
+  cairo_t *cr = cairo_create(icon);
+  cairo_set_source_rgb(cr, 0.2, 0.4, 0.8);
+  cairo_rectangle(cr, 2, 2, 20, 20);
+  cairo_fill(cr);
+  cairo_destroy(cr);
+  cairo_surface_write_to_png(icon, path);
+  cairo_surface_destroy(icon);
+  return path;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -n results   results per frame (50)\n"
+          "  -r count     measured repetitions (20)\n"
+          "  -t ms        minimal duration of a repetition (50)\n"
+          "  -f font      font name (monospace)\n"
+          "  -o file.png  write the last frame drawn to a png\n",
+          name);
+}
+
+int main(int argc, char **argv) {
+  bench_options_t options = { 20, 50 };
+  uint32_t results = 50;
+  char *output = NULL;
+  settings.font_name = "monospace";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:t:f:o:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        results = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        options.repetitions = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        options.target_ms = strtod(optarg, NULL);
+        break;
+      case 'f':
+        settings.font_name = optarg;
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (!results) {
+    /* The highlight moves modulo the number of results. */
+    fprintf(stderr, "-n must be at least 1.\n");
+    return 1;
+  }
+
+  /* Same defaults as initialize_settings. */
+  settings.query_fg.r = settings.highlight_fg.r = 0.1;
+  settings.query_fg.g = settings.highlight_fg.g = 0.1;
+  settings.query_fg.b = settings.highlight_fg.b = 0.1;
+  settings.result_fg = (color_t){ 0.5, 0.5, 0.5 };
+  settings.query_bg = settings.result_bg = (color_t){ 1.0, 1.0, 1.0 };
+  settings.highlight_bg = (color_t){ 0.8, 0.8, 0.8 };
+  settings.font_size = 18;
+  settings.desc_font_size = 16;
+  settings.horiz_padding = 5;
+  settings.cursor_padding = 4;
+  settings.height = 30;
+  settings.max_height = 7 * settings.height;
+  settings.width = 500;
+  settings.desc_size = 300;
+  settings.line_gap = 20;
+  settings.auto_center = 1;
+  pthread_mutex_init(&global.draw_mutex, NULL);
+  pthread_mutex_init(&global.result_mutex, NULL);
+
+  struct render_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, settings.width + settings.desc_size, settings.max_height);
+  ctx.cr = cairo_create(ctx.surface);
+  cairo_set_line_width(ctx.cr, 2);
+  strcpy(ctx.query, "benchmark query");
+
+  cairo_select_font_face(ctx.cr, settings.font_name, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size(ctx.cr, settings.font_size);
+  cairo_font_extents_t extents;
+  cairo_font_extents(ctx.cr, &extents);
+  global.real_font_size = extents.height;
+  cairo_set_font_size(ctx.cr, settings.desc_font_size);
+  cairo_font_extents(ctx.cr, &extents);
+  global.real_desc_font_size = extents.height;
+
+  char *icon = create_icon();
+
+  frame_spec_t plain;
+  frame_spec_default(&plain);
+  plain.results = results;
+  plain.escape_density = 0;
+  plain.markup_density = 0;
+
+  frame_spec_t markup = plain;
+  markup.markup_density = 0.6;
+
+  frame_spec_t icons = plain;
+  icons.image_density = icon ? 1.0 : 0.0;
+  icons.image_path = icon;
+
+  frame_spec_t descriptions = plain;
+  descriptions.desc_size = 2000;
+
+  printf("offscreen %ux%u, %u results per frame\n\n", settings.width + settings.desc_size, settings.max_height, results);
+  bench_print_header();
+
+  run_workload("draw_result_text plain", &ctx, &plain, bench_draw_result_text, &options);
+  run_workload("draw_result_text bold/centered", &ctx, &markup, bench_draw_result_text, &options);
+  run_workload("draw_result_text icons", &ctx, &icons, bench_draw_result_text, &options);
+  run_workload("draw_result_text long descriptions", &ctx, &descriptions, bench_draw_result_text, &options);
+  ctx.move_highlight = 1;
+  run_workload("draw_result_text moving highlight", &ctx, &plain, bench_draw_result_text, &options);
+  ctx.move_highlight = 0;
+  run_workload("redraw_all plain", &ctx, &plain, bench_redraw_all, &options);
+
+  if (output) {
+    cairo_surface_flush(ctx.surface);
+    cairo_surface_write_to_png(ctx.surface, output);
+  }
+  if (icon) {
+    unlink(icon);
+  }
+  cairo_destroy(ctx.cr);
+  cairo_surface_destroy(ctx.surface);
+  return 0;
+}
@@ -10,6 +10,8 @@ import subprocess
 import json
 import os
 
+import names
+
 MAX_OUTPUT = 100 * 1024
 
 resultStr = Array(c_char, MAX_OUTPUT);
@@ -74,68 +76,12 @@ def get_process_output(process, formatting, action):
     out_action = action
   return (out_str, out_action)
 
-def get_xdg_cmd(cmd):
-
-    import re
-
-    try:
-        import xdg.BaseDirectory
-        import xdg.DesktopEntry
-        import xdg.IconTheme
-    except ImportError:
-        return
-
-    def find_desktop_entry(cmd):
-
-        search_name = "%s.desktop" % cmd
-        desktop_files = list(xdg.BaseDirectory.load_data_paths('applications',
-                                                               search_name))
-        if not desktop_files:
-            return
-        else:
-            # Earlier paths take precedence.
-            desktop_file = desktop_files[0]
-            desktop_entry = xdg.DesktopEntry.DesktopEntry(desktop_file)
-            return desktop_entry
-
-    def get_icon(desktop_entry):
-
-        icon_name = desktop_entry.getIcon()
-        if not icon_name:
-            return
-        else:
-            icon_path = xdg.IconTheme.getIconPath(icon_name)
-            return icon_path
-
-    def get_xdg_exec(desktop_entry):
-
-        exec_spec = desktop_entry.getExec()
-        # The XDG exec string contains substitution patterns.
-        exec_path = re.sub("%.", "", exec_spec).strip()
-        return exec_path
-
-    desktop_entry = find_desktop_entry(cmd)
-    if not desktop_entry:
-        return
-
-    exec_path = get_xdg_exec(desktop_entry)
-    if not exec_path:
-        return
-
-    icon = get_icon(desktop_entry)
-    if not icon:
-        menu_entry = cmd
-    else:
-        menu_entry = "%%I%s%%%s" % (icon, cmd)
-
-    return (menu_entry, exec_path)
-
-
 special = {
     "bat": (lambda x: get_process_output("acpi", "%s", "")),
     "vi": (lambda x: ("vim","urxvt -e vim")),
 }
 
+name_index = None
 while 1:
     userInput = sys.stdin.readline()
     userInput = userInput[:-1]
@@ -153,15 +99,13 @@ while 1:
         continue
 
     try:
-        complete = subprocess.check_output("compgen -c %s" % (userInput),
-                                               shell=True, executable="/bin/bash")
-        complete = complete.split('\n')
-
-        for cmd_num in range(min(len(complete), 5)):
-                # Look for XDG applications of the given name.
-                xdg_cmd = get_xdg_cmd(complete[cmd_num])
-                if xdg_cmd:
-                    append_output(*xdg_cmd)
+        # Look for XDG applications of the given name, the index is only
+        # rebuilt when the applications change.
+        name_index = names.load(name_index)
+        for name, action, icon, kind in names.complete(name_index, userInput, 5, ("application",)):
+            if icon:
+                name = "%%I%s%%%s" % (icon, name)
+            append_output(name, action)
 
     except:
         # if no command exist with the user input
@@ -0,0 +1,279 @@
+#!/usr/bin/python2.7
+"""
+Completion of the names of commands, applications and aliases.
+
+The names are kept in a trie flattened in preorder: the nodes under a node
+are the ones right after it, so once the query is walked down (a step per
+character) the completions are read in order, without scanning the others.
+Every name carries its action, icon and kind.
+
+The trie is saved in ~/.cache/lighthouse/names.json, and rebuilt when a
+directory of $PATH changes, an application is added, removed or edited, or
+~/.bashrc (or ~/.bash_aliases) is.
+
+    python names.py fire
+"""
+import json
+import os
+import re
+import subprocess
+import sys
+
+CACHE = os.path.expanduser("~/.cache/lighthouse/names.json")
+VERSION = 3
+
+# Label of the root, no name has one.
+ROOT = "/"
+
+
+def path_dirs():
+    return [d for d in os.environ.get("PATH", "").split(":") if d]
+
+
+def application_dirs():
+    data_home = os.environ.get("XDG_DATA_HOME") or "~/.local/share"
+    data_dirs = os.environ.get("XDG_DATA_DIRS") or "/usr/local/share:/usr/share"
+    return [os.path.join(os.path.expanduser(d), "applications")
+            for d in [data_home] + data_dirs.split(":") if d]
+
+
+def alias_files():
+    return [os.path.expanduser(f) for f in ("~/.bashrc", "~/.bash_aliases")]
+
+
+def stamp():
+    """
+    Modification times of everything the names come from: the directories
+    of $PATH (commands added or removed), the alias files, and for each
+    applications directory the newest of its own and of its .desktop files
+    (edited ones too).
+    """
+    res = []
+    for path in path_dirs() + alias_files():
+        try:
+            res.append([path, os.stat(path).st_mtime])
+        except OSError:
+            res.append([path, 0])
+    for d in application_dirs():
+        try:
+            newest = os.stat(d).st_mtime
+            files = os.listdir(d)
+        except OSError:
+            res.append([d, 0])
+            continue
+        for f in files:
+            if f.endswith(".desktop"):
+                try:
+                    newest = max(newest, os.stat(os.path.join(d, f)).st_mtime)
+                except OSError:
+                    pass
+        res.append([d, newest])
+    return res
+
+
+def commands():
+    names = {}
+    for d in path_dirs():
+        try:
+            files = os.listdir(d)
+        except OSError:
+            continue
+        for f in files:
+            path = os.path.join(d, f)
+            # Earlier directories take precedence, as in the shell.
+            if f not in names and os.access(path, os.X_OK) and not os.path.isdir(path):
+                names[f] = [f, None]
+    return names
+
+
+def read_desktop_entry(path):
+    """
+    The keys of the [Desktop Entry] group of a .desktop file.
+    """
+    keys = {}
+    group = None
+    try:
+        with open(path) as desktop_file:
+            for line in desktop_file:
+                line = line.strip()
+                if line.startswith("["):
+                    group = line
+                elif group == "[Desktop Entry]" and "=" in line:
+                    key, value = line.split("=", 1)
+                    keys[key.strip()] = value.strip()
+    except (IOError, OSError):
+        pass
+    return keys
+
+
+def find_icon(icon_name):
+    if not icon_name or os.path.isabs(icon_name):
+        return icon_name or None
+    try:
+        import xdg.IconTheme
+    except ImportError:
+        return None
+    return xdg.IconTheme.getIconPath(icon_name)
+
+
+def applications():
+    names = {}
+    # Hidden entries mask those of the same name in later directories.
+    hidden = set()
+    for d in application_dirs():
+        try:
+            files = os.listdir(d)
+        except OSError:
+            continue
+        for f in files:
+            name = f[:-len(".desktop")]
+            if not f.endswith(".desktop") or name in names or name in hidden:
+                continue
+            keys = read_desktop_entry(os.path.join(d, f))
+            if keys.get("Hidden") == "true":
+                hidden.add(name)
+                continue
+            if not keys.get("Exec"):
+                continue
+            # The XDG exec string contains substitution patterns.
+            action = re.sub("%.", "", keys["Exec"]).strip()
+            names[name] = [action, find_icon(keys.get("Icon"))]
+    return names
+
+
+def aliases():
+    names = {}
+    try:
+        with open(os.devnull, "w") as devnull:
+            out = subprocess.check_output(["bash", "-ic", "alias"],
+                                          stdin=devnull, stderr=devnull)
+    except (OSError, subprocess.CalledProcessError):
+        return names
+    for line in out.decode("utf-8", "replace").splitlines():
+        match = re.match(r"alias ([^=]+)='(.*)'$", line)
+        if match:
+            # The action runs in sh, so the alias is expanded.
+            names[match.group(1)] = [match.group(2).replace("'\\''", "'"), None]
+    return names
+
+
+def collect():
+    """
+    All the names, as sorted [name, action, icon, kind] entries. An
+    application hides the command of the same name, an alias both.
+    """
+    entries = {}
+    for kind, names in (("command", commands()),
+                        ("application", applications()),
+                        ("alias", aliases())):
+        for name, (action, icon) in names.items():
+            if name and ROOT not in name:
+                entries[name] = [name, action, icon, kind]
+    return [entries[name] for name in sorted(entries)]
+
+
+def build(entries):
+    """
+    Flattens the trie of the names of entries, sorted. Node i has the label
+    labels[i] (the character leading to it), sizes[i] nodes from itself on
+    are under it, and payloads[i] is its entry or -1.
+    """
+    labels = []
+    sizes = []
+    payloads = []
+
+    def add(label, indices, depth):
+        node = len(labels)
+        labels.append(label)
+        sizes.append(0)
+        payloads.append(-1)
+        i = 0
+        while i < len(indices):
+            name = entries[indices[i]][0]
+            if len(name) == depth:
+                # Sorted, a name comes before the longer ones it starts.
+                payloads[node] = indices[i]
+                i += 1
+                continue
+            j = i
+            while j < len(indices) and entries[indices[j]][0][depth] == name[depth]:
+                j += 1
+            add(name[depth], indices[i:j], depth + 1)
+            i = j
+        sizes[node] = len(labels) - node
+
+    add(ROOT, list(range(len(entries))), 0)
+    return {"labels": "".join(labels),
+            "sizes": sizes,
+            "payloads": payloads,
+            "entries": entries}
+
+
+def load(index=None):
+    """
+    The index: the one given or the saved one if still valid, else a new
+    one, saved.
+    """
+    current = stamp()
+    if index is not None and index.get("stamp") == current:
+        return index
+    try:
+        with open(CACHE) as cache:
+            index = json.load(cache)
+        if index.get("version") == VERSION and index.get("stamp") == current:
+            return index
+    except (IOError, OSError, ValueError):
+        pass
+
+    index = build(collect())
+    index["version"] = VERSION
+    index["stamp"] = current
+    try:
+        if not os.path.isdir(os.path.dirname(CACHE)):
+            os.makedirs(os.path.dirname(CACHE))
+        # Written aside then renamed, a reader never sees half of it.
+        with open(CACHE + ".tmp", "w") as cache:
+            json.dump(index, cache)
+        os.rename(CACHE + ".tmp", CACHE)
+    except (IOError, OSError):
+        pass
+    return index
+
+
+def complete(index, prefix, limit=None, kinds=None):
+    """
+    The [name, action, icon, kind] entries whose name starts with prefix, in
+    order, at most limit of them and only of the given kinds.
+    """
+    labels = index["labels"]
+    sizes = index["sizes"]
+    payloads = index["payloads"]
+    node = 0
+    for c in prefix:
+        child = node + 1
+        end = node + sizes[node]
+        while child < end and labels[child] != c:
+            child += sizes[child]
+        if child >= end:
+            return []
+        node = child
+
+    res = []
+    for n in range(node, node + sizes[node]):
+        if payloads[n] < 0:
+            continue
+        entry = index["entries"][payloads[n]]
+        if kinds is None or entry[3] in kinds:
+            res.append(entry)
+            if limit is not None and len(res) >= limit:
+                break
+    return res
+
+
+if __name__ == "__main__":
+    try:
+        prefix = sys.argv[1]
+    except IndexError:
+        prefix = ""
+    for name, action, icon, kind in complete(load(), prefix):
+        print("%s\t%s\t%s" % (name, kind, action))
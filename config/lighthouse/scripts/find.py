@@ -3,6 +3,26 @@ import subprocess
 import os
 import mimetypes
 import argparse
+import pipes
+
+
+def grep_filters(query):
+    """
+    Turn the query into greps on the paths: every word must be there,
+    '!word' must not be and 'a|b' needs one of them.
+    """
+    filters = []
+    for elem in query.split():
+        if elem.startswith('!'):
+            if len(elem) > 1:
+                filters.append("| grep -v -- %s " % pipes.quote(elem[1:]))
+        elif '|' in elem:
+            alternatives = [x for x in elem.split('|') if x]
+            if alternatives:
+                filters.append("| grep -E -- %s " % pipes.quote('|'.join(alternatives)))
+        else:
+            filters.append("| grep -- %s " % pipes.quote(elem))
+    return " ".join(filters)
 
 
 def find(query, settings):
@@ -10,8 +30,7 @@ def find(query, settings):
     Little fuzzy finder implementation that work with a bash command,
     it also work different according to filetype.
     """
-    command = ["| grep %s " % (elem) for elem in query.split()]
-    command = " ".join(command)
+    command = grep_filters(query)
 
     user = os.path.expanduser('~')
 
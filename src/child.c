@@ -5,41 +5,280 @@
  *         to pull results from the spawned user defined process.
  */
 
+#define _GNU_SOURCE /* POSIX_SPAWN_SETSID */
+
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include <wordexp.h>
 
 #include "child.h"
 #include "display.h"
+#include "filter.h"
 #include "globals.h"
+#include "jsonl.h"
+#include "probes.h"
 #include "results.h"
+#include "session.h"
+#include "stats.h"
+#include "trace.h"
+
+/* @brief Smallest capacity of a frame buffer, it doubles when full. */
+#define FRAME_BUF_MIN     (16 * 1024)
+
+/* @brief Characters that make an action a shell command, see exec_action. */
+#define SHELL_SYNTAX      "|&;<>()$`\\\"'*?[]#~=%{}!\n"
+
+/* @brief Most reads done at once to look for a newer frame, so a backend
+ *        that never stops writing still gets its frames drawn. */
+#define DRAIN_READS       16
+
+/* @brief How long to wait for a backend launched by connect_backend to listen. */
+#define BACKEND_START_MS  2000
+
+/* @brief Written to the cmd, followed by a token, to fetch a description. */
+#define DESC_REQUEST      "\033desc "
 
-/* @brief Checks if the buffer has a newline.
+/* @brief A frame of its own, written by a cmd that answers the boolean_prefix
+ *        queries itself. */
+#define BOOLEAN_DECLARATION "%B%"
+
+/* @brief Wakes the results thread up when the highlight moves, see wake_results. */
+static int32_t wake_pipe[2] = { -1, -1 };
+
+/* @brief The token of the last description requested, so it isn't requested
+ *        again while the cmd answers. Only used by the results thread. */
+static char *desc_requested = NULL;
+static uint32_t desc_requested_length = 0;
+
+/* @brief A growable buffer the frames are read into, the results of a frame
+ *        point into it. The capacity is kept from one frame to the next. */
+typedef struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+} frame_buf_t;
+
+/* @brief Makes sure the buffer can hold at least capacity bytes.
  *
- * If there is a newline it is replaced with a null terminator
- * and 1 is returned, otherwise 0 is returned.
+ * @param buf The buffer.
+ * @param capacity The capacity needed.
+ * @return 0 on success and 1 on failure.
+ */
+static int32_t reserve_frame_buf(frame_buf_t *buf, size_t capacity) {
+  if (capacity <= buf->capacity) {
+    return 0;
+  }
+  size_t new_capacity = buf->capacity ? buf->capacity : FRAME_BUF_MIN;
+  while (new_capacity < capacity) {
+    new_capacity *= 2;
+  }
+  char *data = realloc(buf->data, new_capacity);
+  if (!data) {
+    fprintf(stderr, "Couldn't allocate %zu bytes for the results.\n", new_capacity);
+    return 1;
+  }
+  buf->data = data;
+  buf->capacity = new_capacity;
+  return 0;
+}
+
+/* @brief Requests the description of the highlighted result once it has
+ *        been highlighted for settings.desc_dwell milliseconds.
  *
- * @param buf The buffer to be scanned for a newline.
- * @param len The length of the buffer.
- * @return 1 if there exists a newline in the buffer, else 0.
+ * Only results whose description is a token (%D<token>%) are fetched, and
+ * only if the description isn't cached yet.
+ *
+ * @return How many milliseconds to wait before calling it again, -1 for none.
  */
-int32_t find_newline(char *buf, size_t len) {
-  uint32_t i;
-  for (i = 0; i < len; i++) {
-    if (buf[i] == '\n') {
-      buf[i] = '\0';
-      return 1;
+static int32_t fetch_desc(void) {
+  int32_t timeout = -1;
+  pthread_mutex_lock(&global.result_mutex);
+  if (!global.to_child || !global.results || global.result_highlight >= global.result_count) {
+    goto done;
+  }
+  const char *desc = result_string(global.result_base, global.results[global.result_highlight].desc);
+  const char *token;
+  uint32_t length;
+  if (!desc || !parse_desc_token(desc, &token, &length) || desc_cache_get(token, length)) {
+    goto done;
+  }
+  if (length == desc_requested_length && !memcmp(token, desc_requested, length)) {
+    goto done;
+  }
+
+  uint64_t due = global.highlight_time + (uint64_t)settings.desc_dwell * 1000000;
+  uint64_t now = trace_now();
+  if (now < due) {
+    timeout = (due - now) / 1000000 + 1;
+    goto done;
+  }
+  char *requested = realloc(desc_requested, length);
+  if (!requested) {
+    goto done;
+  }
+  memcpy(requested, token, length);
+  desc_requested = requested;
+  desc_requested_length = length;
+  if (write_to_remote(global.to_child, DESC_REQUEST "%.*s\n", (int)length, token)) {
+    fprintf(stderr, "Failed to write.\n");
+  }
+
+done:
+  pthread_mutex_unlock(&global.result_mutex);
+  return timeout;
+}
+
+void wake_results(void) {
+  int32_t wake = __atomic_load_n(&wake_pipe[1], __ATOMIC_ACQUIRE);
+  if (wake != -1) {
+    char c = 0;
+    /* Non blocking: if the pipe is full, a wake up is pending anyway. */
+    if (write(wake, &c, 1) < 0) {
+      return;
+    }
+  }
+}
+
+/* @brief Finds the end of a frame: a line, or lines up to an empty one with
+ *        FORMAT_JSONL.
+ *
+ * @param buf The buffer.
+ * @param start Where the frame starts in the buffer.
+ * @param scanned Where to resume looking for the end, updated.
+ * @return The newline ending the frame, or NULL if it isn't all there yet.
+ */
+static char *find_frame_end(frame_buf_t *buf, size_t start, size_t *scanned) {
+  while (buf->length > *scanned) {
+    char *newline = memchr(buf->data + *scanned, '\n', buf->length - *scanned);
+    if (!newline) {
+      break;
     }
-    if (buf[i] == '\0') {
-      return 0;
+    *scanned = newline + 1 - buf->data;
+    if (settings.format != FORMAT_JSONL || newline == buf->data + start || newline[-1] == '\n') {
+      return newline;
     }
   }
-  return 0;
+  *scanned = buf->length;
+  return NULL;
 }
 
+/* @brief Reads once from the fd into the buffer.
+ *
+ * @return The number of bytes read, 0 if interrupted, -1 on error or at the
+ *         end of the input.
+ */
+static ssize_t read_some(int32_t fd, frame_buf_t *buf) {
+  if (reserve_frame_buf(buf, buf->length + 1)) {
+    return -1;
+  }
+  uint64_t read_begin = trace_begin();
+  ssize_t ret = read(fd, buf->data + buf->length, buf->capacity - buf->length);
+  trace_end(TRACE_READ, read_begin, ret > 0 ? ret : 0);
+  if (ret == -1 && errno == EINTR) {
+    return 0;
+  } else if (ret < 0) {
+    fprintf(stderr, "Error in spawned cmd.\n");
+    return -1;
+  } else if (ret == 0) {
+    return -1;
+  }
+  session_record_frame(buf->data + buf->length, ret);
+  buf->length += ret;
+  return ret;
+}
+
+/* @brief Reads from the fd until the buffer holds a full frame (see
+ *        find_frame_end).
+ *
+ * The last newline is replaced with a null terminator. Bytes read past it stay
+ * in the buffer, they are the start of the next frame.
+ *
+ * @param fd The fd to read from.
+ * @param buf The buffer, it may already hold the start of the frame.
+ * @return The length of the frame, or -1 on error or at the end of the input.
+ */
+static int64_t read_frame(int32_t fd, frame_buf_t *buf) {
+  size_t scanned = 0;
+  while (1) {
+    char *end = find_frame_end(buf, 0, &scanned);
+    if (end) {
+      *end = '\0';
+      return end - buf->data;
+    }
+
+    /* While waiting for the cmd, fetch the description of the highlighted
+     * result when it is due. */
+    struct pollfd fds[2] = { { fd, POLLIN, 0 }, { wake_pipe[0], POLLIN, 0 } };
+    int32_t ready = poll(fds, wake_pipe[0] == -1 ? 1 : 2, fetch_desc());
+    if (ready == -1 && errno != EINTR) {
+      fprintf(stderr, "Couldn't poll the cmd: %s\n", strerror(errno));
+      return -1;
+    }
+    if (ready > 0 && fds[1].revents & POLLIN) {
+      char drain[64];
+      while (read(wake_pipe[0], drain, sizeof(drain)) > 0);
+    }
+    if (ready <= 0 || !(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+      continue;
+    }
+    if (read_some(fd, buf) < 0) {
+      return -1;
+    }
+  }
+}
+
+/* @brief Reads what the cmd already wrote, without blocking, and tells if a
+ *        newer full frame (not a page or a description) is complete after
+ *        the current one.
+ *
+ * @param fd The fd to read from.
+ * @param buf The buffer.
+ * @param start Where the frame after the current one starts.
+ * @return 1 if the current frame is stale, else 0.
+ */
+static int32_t newer_frame_buffered(int32_t fd, frame_buf_t *buf, size_t start) {
+  uint32_t reads;
+  for (reads = 0; reads < DRAIN_READS; reads++) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN) || read_some(fd, buf) < 0) {
+      /* At the end of the input, read_frame reports it once the buffered
+       * frames are handled. */
+      break;
+    }
+  }
+
+  size_t scanned = start;
+  char *end;
+  while ((end = find_frame_end(buf, start, &scanned))) {
+    /* Null terminated while looking at it, read_frame finds it again. */
+    *end = '\0';
+    const char *token;
+    uint32_t token_length, total, page_offset;
+    int32_t full = !parse_desc_token(buf->data + start, &token, &token_length)
+      && !(parse_page_header(buf->data + start, &total, &page_offset) && page_offset);
+    *end = '\n';
+    if (full) {
+      return 1;
+    }
+    start = scanned;
+  }
+  return 0;
+}
 
 void *get_results(void *args) {
   int32_t fd = ((struct result_params *)args)->fd;
@@ -48,42 +287,198 @@ void *get_results(void *args) {
   xcb_connection_t *connection = ((struct result_params *)args)->connection;
   xcb_window_t window = ((struct result_params *)args)->window;
 
-  int64_t res;
+  /* Double buffered: a frame is read and parsed in the back buffer while the
+   * results of the previous one, in the front buffer, may still be drawn. */
+  frame_buf_t buffers[2];
+  memset(buffers, 0, sizeof(buffers));
+  int32_t back = 0;
+  /* Bytes of the front buffer holding results, and the length of its page
+   * header (the results are relative to what follows it). */
+  size_t front_used = 0;
+  size_t front_header = 0;
 
+  trace_thread_name("results");
+  int32_t wake[2];
+  if (pipe(wake)) {
+    fprintf(stderr, "Couldn't create wake pipe: %s\n", strerror(errno));
+  } else {
+    fcntl(wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake[1], F_SETFL, O_NONBLOCK);
+    wake_pipe[0] = wake[0];
+    __atomic_store_n(&wake_pipe[1], wake[1], __ATOMIC_RELEASE);
+  }
   while (1) {
-    /* Read until a new line. */
-    res = 0;
-    int32_t ret;
-    do {
-      ret = read(fd, global.result_buf + res, sizeof(global.result_buf) - res);
-      res += ret;
-    } while(!find_newline(global.result_buf, sizeof(global.result_buf))
-            && ret > 0);
-
+    frame_buf_t *buf = &buffers[back];
+    int64_t res = read_frame(fd, buf);
     if (res < 0) {
-      fprintf(stderr, "Error in spawned cmd.\n");
-      return NULL;
-    } else if (res == 0) {
       return NULL;
     }
+
+    const char *token;
+    uint32_t token_length;
+    uint32_t desc_header = parse_desc_token(buf->data, &token, &token_length);
+    if (desc_header) {
+      /* A description fetched by fetch_desc, redrawn if still highlighted. */
+      char *desc_text = buf->data + desc_header;
+      size_t desc_length = res - desc_header;
+      /* With FORMAT_JSONL the newline before the empty line is left. */
+      while (desc_length && desc_text[desc_length - 1] == '\n') {
+        desc_text[--desc_length] = '\0';
+      }
+      pthread_mutex_lock(&global.result_mutex);
+      desc_cache_put(token, token_length, desc_text);
+      if (token_length == desc_requested_length && !memcmp(token, desc_requested, token_length)) {
+        desc_requested_length = 0;
+      }
+      if (global.results && global.result_highlight < global.result_count) {
+        const char *desc = result_string(global.result_base, global.results[global.result_highlight].desc);
+        const char *highlighted;
+        uint32_t highlighted_length;
+        if (desc && parse_desc_token(desc, &highlighted, &highlighted_length)
+            && highlighted_length == token_length && !memcmp(highlighted, token, token_length)) {
+          draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
+        }
+      }
+      pthread_mutex_unlock(&global.result_mutex);
+
+      size_t leftover = buf->length - (res + 1);
+      memmove(buf->data, buf->data + res + 1, leftover);
+      buf->length = leftover;
+      continue;
+    }
+
+    if (!strncmp(buf->data, BOOLEAN_DECLARATION, strlen(BOOLEAN_DECLARATION))) {
+      /* The cmd answers boolean queries, they are sent to it from now on. */
+      pthread_mutex_lock(&global.result_mutex);
+      global.cmd_boolean = 1;
+      pthread_mutex_unlock(&global.result_mutex);
+      debug("The cmd answers boolean queries.\n");
+      size_t leftover = buf->length - (res + 1);
+      memmove(buf->data, buf->data + res + 1, leftover);
+      buf->length = leftover;
+      continue;
+    }
+
+    uint32_t total, page_offset;
+    uint32_t header = parse_page_header(buf->data, &total, &page_offset);
+    if (!(header && page_offset) && newer_frame_buffered(fd, buf, res + 1)) {
+      /* Latest frame wins: the cmd is faster than the drawing, this frame
+       * would be replaced right away, so it isn't parsed nor drawn. */
+      stats_add(STAT_FRAMES_DROPPED, 1);
+      stats_add(STAT_BYTES_READ, res);
+      size_t leftover = buf->length - (res + 1);
+      memmove(buf->data, buf->data + res + 1, leftover);
+      buf->length = leftover;
+      continue;
+    }
+
+    /* After newer_frame_buffered, which may have moved the buffer. */
+    char *text = buf->data + header;
+    size_t length = res - header;
+    size_t leftover = buf->length - (res + 1);
+
     result_t *results = NULL;
-    uint32_t result_count = parse_result_text(global.result_buf, res, &results);
+    uint64_t parse_begin = trace_now();
+    uint32_t result_count = settings.format == FORMAT_JSONL
+      ? parse_result_jsonl(text, length, &results)
+      : parse_result_text(text, length, &results);
+    length = intern_results(text, length, results, result_count);
+    uint64_t parse_end = trace_now();
+    if (trace_enabled) {
+      trace_record(TRACE_PARSE, parse_begin, parse_end, result_count);
+    }
+    stats_add(STAT_PARSE_NS, parse_end - parse_begin);
+    stats_set(STAT_LAST_PARSE_NS, parse_end - parse_begin);
+    stats_frame_received(res, result_count);
+    PROBE1(parse__done, result_count);
+
+    if (header && page_offset) {
+      /* A next page: its results are appended to the front buffer, the back
+       * buffer stays the back buffer. */
+      pthread_mutex_lock(&global.result_mutex);
+      frame_buf_t *front = &buffers[!back];
+      size_t shift = front_used - front_header;
+      /* The results grow first: reserve_frame_buf may move the frame, it
+       * must not fail after that, result_base would point to the old one. */
+      result_t *all = NULL;
+      if (global.frame_results && page_offset == global.frame_count
+          && shift + length + 1 < NO_OFFSET) {
+        all = realloc(global.frame_results, (global.frame_count + result_count + 1) * sizeof(result_t));
+      }
+      if (all) {
+        global.frame_results = all;
+      }
+      if (all && !reserve_frame_buf(front, front_used + length + 1)) {
+        memcpy(front->data + front_used, text, length + 1);
+        front_used += length + 1;
+        uint32_t i;
+        for (i = 0; i < result_count; i++) {
+          result_t *r = &all[global.frame_count + i];
+          *r = results[i];
+          r->text = results[i].text + shift;
+          r->action = results[i].action == NO_OFFSET ? NO_OFFSET : results[i].action + shift;
+          r->desc = results[i].desc == NO_OFFSET ? NO_OFFSET : results[i].desc + shift;
+        }
+        global.result_base = front->data + front_header;
+        global.frame_count += result_count;
+        filter_refresh();
+        debug("Appended %u results at %u.\n", result_count, page_offset);
+        draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
+      } else {
+        if (all) {
+          /* The results moved, not the frame. */
+          filter_refresh();
+        }
+        debug("Dropped a page at %u, %u results loaded.\n", page_offset, global.frame_count);
+      }
+      if (global.page_requested == page_offset) {
+        global.page_requested = 0;
+      }
+      if (total > global.result_total) {
+        global.result_total = total;
+      }
+      pthread_mutex_unlock(&global.result_mutex);
+      free(results);
+
+      memmove(buf->data, buf->data + res + 1, leftover);
+      buf->length = leftover;
+      continue;
+    }
+
     pthread_mutex_lock(&global.result_mutex);
-    if (global.results && results != global.results) {
-      free(global.results);
+    if (global.frame_results && results != global.frame_results) {
+      free(global.frame_results);
     }
-    global.results = results;
-    global.result_count = result_count;
+    global.frame_results = results;
+    global.frame_count = result_count;
+    global.result_base = text;
+    filter_refresh();
+    global.result_total = header && total > result_count ? total : result_count;
+    global.page_requested = 0;
+    global.highlight_time = trace_now();
+    PROBE2(frame__received, res, result_count);
     debug("Recieved %d results.\n", result_count);
     if (global.result_count) {
-        draw_result_text(connection, window, cairo_context, cairo_surface, results);
+        draw_result_text(connection, window, cairo_context, cairo_surface, text, results);
     } else {
       /* If no result found, just draw an empty window. */
-      uint32_t values[] = { settings.width, settings.height };
-      xcb_configure_window (connection, window, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
-      cairo_xcb_surface_set_size(cairo_surface, settings.width, settings.height);
+      resize_window(connection, window, cairo_surface, settings.width, settings.height);
     }
     pthread_mutex_unlock(&global.result_mutex);
+    front_used = header + length + 1;
+    front_header = header;
+
+    /* Nothing points into the old front buffer anymore, it becomes the back
+     * buffer and gets what was read past the end of this frame. */
+    frame_buf_t *next = &buffers[!back];
+    if (reserve_frame_buf(next, leftover)) {
+      return NULL;
+    }
+    if (leftover) {
+      memcpy(next->data, buf->data + res + 1, leftover);
+    }
+    next->length = leftover;
+    back = !back;
   }
 }
 
@@ -95,6 +490,7 @@ void *get_results(void *args) {
  * @return 0 on success and 1 on failure.
  */
 int32_t write_to_remote(FILE *child, char *format, ...) {
+  uint64_t write_begin = trace_begin();
   va_list args;
   va_start(args, format);
   if (vfprintf(child, format, args) < 0) {
@@ -104,10 +500,82 @@ int32_t write_to_remote(FILE *child, char *format, ...) {
   if (fflush(child)) {
     return -1;
   }
+  trace_end(TRACE_CHILD_WRITE, write_begin, 0);
 
   return 0;
 }
 
+/* @brief Parses the cmd_ionice setting: idle, best-effort[:level] or
+ *        realtime[:level], the level going from 0 (first) to 7.
+ *
+ * @return The I/O priority for ioprio_set, or -1 if it isn't valid.
+ */
+static int32_t parse_ionice(const char *ionice) {
+  static const char *classes[] = { "realtime", "best-effort", "idle" };
+  uint32_t i;
+  for (i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+    size_t length = strlen(classes[i]);
+    if (!strncmp(ionice, classes[i], length) && (ionice[length] == '\0' || ionice[length] == ':')) {
+      uint32_t level = ionice[length] == ':' ? strtoul(ionice + length + 1, NULL, 10) : 4;
+      return ((i + 1) << 13) | (level > 7 ? 7 : level);
+    }
+  }
+  return -1;
+}
+
+/* @brief Applies the cmd_* limits of the settings to the calling process, the
+ *        cmd between its fork and its exec, so it can't starve the drawing.
+ *
+ * Failures are reported and the cmd runs anyway.
+ *
+ * @return Void.
+ */
+static void apply_cmd_limits(void) {
+  if (settings.cmd_nice && setpriority(PRIO_PROCESS, 0, settings.cmd_nice)) {
+    fprintf(stderr, "Couldn't set the nice value of the cmd: %s\n", strerror(errno));
+  }
+  if (settings.cmd_ionice) {
+    int32_t priority = parse_ionice(settings.cmd_ionice);
+    if (priority == -1) {
+      fprintf(stderr, "Unknown I/O class %s.\n", settings.cmd_ionice);
+    }
+#ifdef SYS_ioprio_set
+    else if (syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, priority)) {
+      fprintf(stderr, "Couldn't set the I/O class of the cmd: %s\n", strerror(errno));
+    }
+#endif
+  }
+
+  struct rlimit limit;
+  if (settings.cmd_cpu_limit) {
+    limit.rlim_cur = limit.rlim_max = settings.cmd_cpu_limit;
+    if (setrlimit(RLIMIT_CPU, &limit)) {
+      fprintf(stderr, "Couldn't limit the CPU time of the cmd: %s\n", strerror(errno));
+    }
+  }
+  if (settings.cmd_memory_limit) {
+    limit.rlim_cur = limit.rlim_max = (rlim_t)settings.cmd_memory_limit * 1024 * 1024;
+    if (setrlimit(RLIMIT_AS, &limit)) {
+      fprintf(stderr, "Couldn't limit the memory of the cmd: %s\n", strerror(errno));
+    }
+  }
+
+  if (settings.cmd_cgroup) {
+    /* A cgroup v2 directory delegated to the user, created if needed. Writing
+     * 0 to cgroup.procs moves the writer. */
+    char procs[PATH_MAX];
+    snprintf(procs, sizeof(procs), "%s/cgroup.procs", settings.cmd_cgroup);
+    mkdir(settings.cmd_cgroup, 0755);
+    int32_t fd = open(procs, O_WRONLY);
+    if (fd == -1 || write(fd, "0\n", 2) != 2) {
+      fprintf(stderr, "Couldn't move the cmd to %s: %s\n", settings.cmd_cgroup, strerror(errno));
+    }
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+}
+
 /* @brief Spawns a process (via fork) and sets up pipes to allow communication with
  *        the user defined executable.
  *
@@ -142,6 +610,7 @@ int32_t spawn_piped_process(char *file, int32_t *to_child_fd, int32_t *from_chil
     close(in_pipe[1]);
     dup2(in_pipe[0], STDIN_FILENO);
     dup2(out_pipe[1], STDOUT_FILENO);
+    apply_cmd_limits();
 
     wordexp_t expanded_file;
     if (wordexp(file, &expanded_file, 0)) {
@@ -169,3 +638,212 @@ int32_t spawn_piped_process(char *file, int32_t *to_child_fd, int32_t *from_chil
   return 0;
 }
 
+/* @brief Runs the command starting a backend, detached: in its own session,
+ *        not a child of lighthouse, so it isn't killed when lighthouse exits,
+ *        its standard streams on /dev/null and no other fd of lighthouse open.
+ *
+ * @param file The command, expanded as the cmd is, maybe with its arguments.
+ * @param path The socket path, passed in LIGHTHOUSE_SOCKET.
+ * @param argv The arguments of the cmd, used if file has none.
+ * @return 0 on success and 1 on failure.
+ */
+static int32_t launch_backend(char *file, const char *path, char **argv) {
+  pid_t pid = fork();
+  if (pid == -1) {
+    fprintf(stderr, "Couldn't launch backend: %s\n", strerror(errno));
+    return 1;
+  }
+
+  if (pid == 0) {
+    /* The grandchild is reparented to init when this one exits. */
+    if (fork()) {
+      _exit(0);
+    }
+    setsid();
+    /* Nothing of lighthouse is kept open: its pipes (the action read by sh),
+     * its terminal, its X connection. */
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    int32_t null_fd = open("/dev/null", O_RDWR);
+    if (null_fd != -1) {
+      dup2(null_fd, STDIN_FILENO);
+      dup2(null_fd, STDOUT_FILENO);
+      dup2(null_fd, STDERR_FILENO);
+    }
+    int32_t fd;
+    for (fd = STDERR_FILENO + 1; fd < (max_fd > 0 ? max_fd : 1024); fd++) {
+      close(fd);
+    }
+    setenv("LIGHTHOUSE_SOCKET", path, 1);
+    apply_cmd_limits();
+
+    wordexp_t expanded_file;
+    if (wordexp(file, &expanded_file, 0) || !expanded_file.we_wordc) {
+      fprintf(stderr, "Error expanding file %s\n", file);
+    } else if (expanded_file.we_wordc > 1) {
+      /* The command comes with its own arguments. */
+      argv = expanded_file.we_wordv;
+      file = argv[0];
+    } else {
+      file = expanded_file.we_wordv[0];
+    }
+    argv[0] = file;
+    execvp(file, (char * const *)argv);
+    fprintf(stderr, "Couldn't execute file: %s\n", strerror(errno));
+    _exit(127);
+  }
+
+  waitpid(pid, NULL, 0);
+  return 0;
+}
+
+/* @brief Connects to a unix socket.
+ *
+ * @return The fd, or -1 on failure (errno is set).
+ */
+static int32_t connect_socket(const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  int32_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address))) {
+    int32_t error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+  return fd;
+}
+
+/* @brief Connects to a backend listening on a unix socket, launching it first
+ *        if nothing listens there. The backend keeps running after lighthouse
+ *        exits, and serves the next one (see kill_zombie).
+ *
+ * The protocol is the one of a piped cmd, over the connection.
+ *
+ * @param path The socket path, expanded as the cmd is.
+ * @param launch The command starting the backend, or NULL.
+ * @param to_child_fd The fd used to write to the backend.
+ * @param from_child_fd The fd used to read from the backend.
+ * @param argv The arguments of the cmd, for the backend.
+ * @return 0 on success and 1 on failure.
+ */
+int32_t connect_backend(char *path, char *launch, int32_t *to_child_fd, int32_t *from_child_fd, char **argv) {
+  wordexp_t expanded_path;
+  int32_t expanded = !wordexp(path, &expanded_path, 0) && expanded_path.we_wordc;
+  if (expanded) {
+    path = expanded_path.we_wordv[0];
+  }
+
+  int32_t fd = connect_socket(path);
+  if (fd == -1 && (errno == ENOENT || errno == ECONNREFUSED) && launch) {
+    debug("No backend on %s, launching %s.\n", path, launch);
+    if (!launch_backend(launch, path, argv)) {
+      struct timespec delay = { 0, 10 * 1000 * 1000 };
+      uint32_t waited;
+      for (waited = 0; waited < BACKEND_START_MS && fd == -1; waited += 10) {
+        nanosleep(&delay, NULL);
+        fd = connect_socket(path);
+      }
+    }
+  }
+  if (fd == -1) {
+    fprintf(stderr, "Couldn't connect to backend %s: %s\n", path, strerror(errno));
+    if (expanded) {
+      wordfree(&expanded_path);
+    }
+    return 1;
+  }
+  if (expanded) {
+    wordfree(&expanded_path);
+  }
+
+  *to_child_fd = fd;
+  *from_child_fd = dup(fd);
+  if (*from_child_fd == -1) {
+    fprintf(stderr, "Couldn't duplicate socket: %s\n", strerror(errno));
+    close(fd);
+    return 1;
+  }
+  return 0;
+}
+
+/* @brief Runs a selected action, detached from lighthouse: in its own
+ *        session, its standard in and out on /dev/null.
+ *
+ * An action without shell syntax is split on blanks and run directly, the
+ * others are run with /bin/sh -c.
+ *
+ * @param action The action.
+ * @return 0 on success and 1 on failure.
+ */
+int32_t exec_action(const char *action) {
+  size_t length = strlen(action);
+  char *words = malloc(length + 1);
+  char **argv = malloc((length / 2 + 4) * sizeof(char *));
+  if (!words || !argv) {
+    free(words);
+    free(argv);
+    return 1;
+  }
+  memcpy(words, action, length + 1);
+
+  uint32_t argc = 0;
+  if (strpbrk(action, SHELL_SYNTAX)) {
+    argv[argc++] = "/bin/sh";
+    argv[argc++] = "-c";
+    argv[argc++] = words;
+  } else {
+    char *word = strtok(words, " \t");
+    while (word) {
+      argv[argc++] = word;
+      word = strtok(NULL, " \t");
+    }
+  }
+  argv[argc] = NULL;
+
+  int32_t ret = 0;
+  if (argc) {
+    posix_spawn_file_actions_t file_actions;
+    posix_spawnattr_t attributes;
+    posix_spawn_file_actions_init(&file_actions);
+    posix_spawn_file_actions_addopen(&file_actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&file_actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawnattr_init(&attributes);
+    /* The main thread blocks SIGUSR1 and SIGUSR2 for the stats and trace
+     * threads, the application starts with no signal blocked. */
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGUSR2);
+    posix_spawnattr_setsigdefault(&attributes, &signals);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_SETSID
+    posix_spawnattr_setflags(&attributes, flags | POSIX_SPAWN_SETSID);
+#else
+    posix_spawnattr_setflags(&attributes, flags | POSIX_SPAWN_SETPGROUP);
+#endif
+    /* Not waited for: it is reparented to init when lighthouse exits, right
+     * after. */
+    pid_t pid;
+    int32_t error = posix_spawnp(&pid, argv[0], &file_actions, &attributes, argv, environ);
+    if (error) {
+      fprintf(stderr, "Couldn't execute %s: %s\n", argv[0], strerror(error));
+      ret = 1;
+    }
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&file_actions);
+  }
+  free(argv);
+  free(words);
+  return ret;
+}
@@ -0,0 +1,682 @@
+/** @file dfa.c
+ *
+ *  @brief This file contains the regular expressions of the local filter: a
+ *         pattern is compiled to an NFA (Thompson's construction), which is
+ *         turned into a DFA lazily, a state when a text first needs it.
+ *
+ *  There is no backtracking: a text is scanned once, with one table lookup
+ *  per byte once the states it goes through are built. The number of states
+ *  kept is bounded, the cache is emptied when it is full. Bytes the pattern
+ *  doesn't tell apart share a column of the transition tables.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dfa.h"
+#include "globals.h"
+#include "stats.h"
+
+/* @brief Compiled patterns kept, the least recently used one is replaced. */
+#define DFA_CACHE_SIZE    8
+
+/* @brief Most DFA states kept for a pattern before starting over. */
+#define MAX_DFA_STATES    512
+
+/* @brief End of a list of unpatched transitions, and an unknown transition. */
+#define NO_STATE          UINT32_MAX
+
+typedef enum {
+  NFA_SET, /* Consumes a byte of the set. */
+  NFA_SPLIT, /* Goes to out and out1 without consuming. */
+  NFA_EMPTY, /* Goes to out without consuming. */
+  NFA_BEGIN, /* Goes to out at the start of the text only (^). */
+  NFA_END, /* Goes to out at the end of the text only ($). */
+  NFA_MATCH
+} nfa_type_t;
+
+typedef struct {
+  nfa_type_t type;
+  uint32_t out;
+  uint32_t out1;
+  uint32_t set;
+} nfa_state_t;
+
+/* @brief A set of bytes, one bit per byte. */
+typedef struct {
+  uint32_t bits[8];
+} byte_set_t;
+
+/* @brief A part of the NFA being built: its start, and the list of its
+ *        transitions still to patch (see patch). */
+typedef struct {
+  uint32_t start;
+  uint32_t out;
+} fragment_t;
+
+typedef struct {
+  uint32_t *nfa; /* The NFA states (sets, ends and match), sorted. */
+  uint32_t count;
+  uint32_t hash;
+  int32_t match;
+  int32_t end_match; /* Matches if the text ends here, -1 until computed. */
+  uint32_t *next; /* By byte class, NO_STATE until computed. */
+} dfa_state_t;
+
+struct dfa_s {
+  nfa_state_t *nfa;
+  uint32_t nfa_count;
+  uint32_t nfa_capacity;
+  byte_set_t *sets;
+  uint32_t set_count;
+  uint32_t start;
+  int32_t fold_case;
+
+  uint8_t byte_class[256];
+  uint8_t class_byte[256]; /* A byte of each class. */
+  uint32_t class_count;
+
+  dfa_state_t states[MAX_DFA_STATES];
+  uint32_t state_count;
+  uint32_t flushes;
+  uint32_t table[MAX_DFA_STATES * 2]; /* Open addressing, indices in states. */
+  uint32_t start_state;
+
+  /* Scratch space of the closures. */
+  uint32_t *marks;
+  uint32_t generation;
+  uint32_t *stack;
+  uint32_t *closure;
+};
+
+/* @brief The pattern being parsed. */
+typedef struct {
+  const char *c;
+  dfa_t *dfa;
+  int32_t error;
+} parser_t;
+
+static inline void set_add(byte_set_t *set, uint8_t byte) {
+  set->bits[byte >> 5] |= 1u << (byte & 31);
+}
+
+static inline int32_t set_has(const byte_set_t *set, uint8_t byte) {
+  return (set->bits[byte >> 5] >> (byte & 31)) & 1;
+}
+
+static void set_add_range(byte_set_t *set, uint8_t from, uint8_t to) {
+  uint32_t b;
+  for (b = from; b <= to; b++) {
+    set_add(set, b);
+  }
+}
+
+static uint32_t new_state(parser_t *p, nfa_type_t type, uint32_t out, uint32_t out1, uint32_t set) {
+  dfa_t *dfa = p->dfa;
+  if (dfa->nfa_count == dfa->nfa_capacity) {
+    uint32_t capacity = dfa->nfa_capacity ? dfa->nfa_capacity * 2 : 64;
+    nfa_state_t *nfa = realloc(dfa->nfa, capacity * sizeof(nfa_state_t));
+    if (!nfa) {
+      p->error = 1;
+      return 0;
+    }
+    dfa->nfa = nfa;
+    dfa->nfa_capacity = capacity;
+  }
+  dfa->nfa[dfa->nfa_count] = (nfa_state_t){ type, out, out1, set };
+  return dfa->nfa_count++;
+}
+
+static uint32_t new_set(parser_t *p, const byte_set_t *set) {
+  dfa_t *dfa = p->dfa;
+  byte_set_t *sets = realloc(dfa->sets, (dfa->set_count + 1) * sizeof(byte_set_t));
+  if (!sets) {
+    p->error = 1;
+    return 0;
+  }
+  dfa->sets = sets;
+  dfa->sets[dfa->set_count] = *set;
+  return dfa->set_count++;
+}
+
+/* The unpatched transitions of a fragment are chained through themselves:
+ * an entry is a state times 2, plus 1 for its out1, and holds the next one. */
+static inline uint32_t *transition(dfa_t *dfa, uint32_t entry) {
+  return entry & 1 ? &dfa->nfa[entry >> 1].out1 : &dfa->nfa[entry >> 1].out;
+}
+
+static void patch(dfa_t *dfa, uint32_t list, uint32_t target) {
+  while (list != NO_STATE) {
+    uint32_t *t = transition(dfa, list);
+    list = *t;
+    *t = target;
+  }
+}
+
+static uint32_t append(dfa_t *dfa, uint32_t list, uint32_t other) {
+  if (list == NO_STATE) {
+    return other;
+  }
+  uint32_t last = list;
+  while (*transition(dfa, last) != NO_STATE) {
+    last = *transition(dfa, last);
+  }
+  *transition(dfa, last) = other;
+  return list;
+}
+
+static fragment_t set_fragment(parser_t *p, const byte_set_t *set) {
+  uint32_t state = new_state(p, NFA_SET, NO_STATE, NO_STATE, new_set(p, set));
+  return (fragment_t){ state, state * 2 };
+}
+
+static fragment_t concat(parser_t *p, fragment_t a, fragment_t b) {
+  patch(p->dfa, a.out, b.start);
+  return (fragment_t){ a.start, b.out };
+}
+
+static fragment_t alternate(parser_t *p, fragment_t a, fragment_t b) {
+  uint32_t split = new_state(p, NFA_SPLIT, a.start, b.start, 0);
+  return (fragment_t){ split, append(p->dfa, a.out, b.out) };
+}
+
+static fragment_t empty_fragment(parser_t *p, nfa_type_t type) {
+  uint32_t state = new_state(p, type, NO_STATE, NO_STATE, 0);
+  return (fragment_t){ state, state * 2 };
+}
+
+/* @brief Adds the other case of the ASCII letters of a set. */
+static void fold_set(byte_set_t *set) {
+  uint32_t b;
+  for (b = 'a'; b <= 'z'; b++) {
+    if (set_has(set, b) || set_has(set, b - 'a' + 'A')) {
+      set_add(set, b);
+      set_add(set, b - 'a' + 'A');
+    }
+  }
+}
+
+/* @brief Parses the letter after a backslash into a set. */
+static void escape_set(char c, byte_set_t *set) {
+  byte_set_t class;
+  memset(&class, 0, sizeof(class));
+  switch (c) {
+    case 'd': case 'D':
+      set_add_range(&class, '0', '9');
+      break;
+    case 'w': case 'W':
+      set_add_range(&class, '0', '9');
+      set_add_range(&class, 'a', 'z');
+      set_add_range(&class, 'A', 'Z');
+      set_add(&class, '_');
+      break;
+    case 's': case 'S':
+      set_add(&class, ' ');
+      set_add_range(&class, '\t', '\r');
+      break;
+    case 'n':
+      set_add(&class, '\n');
+      break;
+    case 't':
+      set_add(&class, '\t');
+      break;
+    default:
+      set_add(&class, c);
+      break;
+  }
+  uint32_t i;
+  for (i = 0; i < 8; i++) {
+    set->bits[i] |= (c == 'D' || c == 'W' || c == 'S') ? ~class.bits[i] : class.bits[i];
+  }
+}
+
+/* @brief Parses [...], the parser is past the opening bracket. */
+static fragment_t parse_class(parser_t *p) {
+  byte_set_t set;
+  memset(&set, 0, sizeof(set));
+  int32_t negated = *p->c == '^';
+  if (negated) {
+    p->c++;
+  }
+  int32_t first = 1;
+  while (*p->c && (*p->c != ']' || first)) {
+    first = 0;
+    uint8_t from = *p->c++;
+    if (from == '\\' && *p->c) {
+      escape_set(*p->c++, &set);
+      continue;
+    }
+    if (p->c[0] == '-' && p->c[1] && p->c[1] != ']') {
+      uint8_t to = p->c[1];
+      p->c += 2;
+      if (to < from) {
+        p->error = 1;
+        break;
+      }
+      set_add_range(&set, from, to);
+    } else {
+      set_add(&set, from);
+    }
+  }
+  if (*p->c != ']') {
+    p->error = 1;
+    return empty_fragment(p, NFA_EMPTY);
+  }
+  p->c++;
+  if (p->dfa->fold_case) {
+    fold_set(&set);
+  }
+  if (negated) {
+    uint32_t i;
+    for (i = 0; i < 8; i++) {
+      set.bits[i] = ~set.bits[i];
+    }
+  }
+  return set_fragment(p, &set);
+}
+
+/* @brief A whole UTF-8 character, for the dot. */
+static fragment_t dot_fragment(parser_t *p) {
+  byte_set_t ascii, lead2, lead3, lead4, tail;
+  memset(&ascii, 0, sizeof(ascii));
+  memset(&lead2, 0, sizeof(lead2));
+  memset(&lead3, 0, sizeof(lead3));
+  memset(&lead4, 0, sizeof(lead4));
+  memset(&tail, 0, sizeof(tail));
+  set_add_range(&ascii, 0x01, 0x7F);
+  set_add_range(&lead2, 0xC0, 0xDF);
+  set_add_range(&lead3, 0xE0, 0xEF);
+  set_add_range(&lead4, 0xF0, 0xF7);
+  set_add_range(&tail, 0x80, 0xBF);
+
+  fragment_t two = concat(p, set_fragment(p, &lead2), set_fragment(p, &tail));
+  fragment_t three = concat(p, set_fragment(p, &lead3), concat(p, set_fragment(p, &tail), set_fragment(p, &tail)));
+  fragment_t four = concat(p, set_fragment(p, &lead4),
+                           concat(p, set_fragment(p, &tail), concat(p, set_fragment(p, &tail), set_fragment(p, &tail))));
+  /* A stray continuation byte is a character too, so no text gets stuck. */
+  return alternate(p, set_fragment(p, &ascii),
+                   alternate(p, two, alternate(p, three, alternate(p, four, set_fragment(p, &tail)))));
+}
+
+static fragment_t parse_alternation(parser_t *p);
+
+static fragment_t parse_atom(parser_t *p) {
+  byte_set_t set;
+  memset(&set, 0, sizeof(set));
+  char c = *p->c++;
+  if (c == '(') {
+    fragment_t inner = parse_alternation(p);
+    if (*p->c != ')') {
+      p->error = 1;
+    } else {
+      p->c++;
+    }
+    return inner;
+  } else if (c == '[') {
+    return parse_class(p);
+  } else if (c == '.') {
+    return dot_fragment(p);
+  } else if (c == '^') {
+    return empty_fragment(p, NFA_BEGIN);
+  } else if (c == '$') {
+    return empty_fragment(p, NFA_END);
+  } else if (c == '\\') {
+    if (!*p->c) {
+      p->error = 1;
+      return empty_fragment(p, NFA_EMPTY);
+    }
+    escape_set(*p->c++, &set);
+  } else {
+    set_add(&set, c);
+  }
+  if (p->dfa->fold_case) {
+    fold_set(&set);
+  }
+  return set_fragment(p, &set);
+}
+
+static fragment_t parse_repeat(parser_t *p) {
+  if (*p->c == '*' || *p->c == '+' || *p->c == '?') {
+    p->error = 1; /* Nothing to repeat. */
+    return empty_fragment(p, NFA_EMPTY);
+  }
+  fragment_t f = parse_atom(p);
+  while (!p->error && (*p->c == '*' || *p->c == '+' || *p->c == '?')) {
+    char op = *p->c++;
+    uint32_t split = new_state(p, NFA_SPLIT, f.start, NO_STATE, 0);
+    if (op == '*') {
+      patch(p->dfa, f.out, split);
+      f = (fragment_t){ split, split * 2 + 1 };
+    } else if (op == '+') {
+      patch(p->dfa, f.out, split);
+      f = (fragment_t){ f.start, split * 2 + 1 };
+    } else {
+      f = (fragment_t){ split, append(p->dfa, f.out, split * 2 + 1) };
+    }
+  }
+  return f;
+}
+
+static fragment_t parse_concat(parser_t *p) {
+  fragment_t f = empty_fragment(p, NFA_EMPTY);
+  while (!p->error && *p->c && *p->c != '|' && *p->c != ')') {
+    f = concat(p, f, parse_repeat(p));
+  }
+  return f;
+}
+
+static fragment_t parse_alternation(parser_t *p) {
+  fragment_t f = parse_concat(p);
+  while (!p->error && *p->c == '|') {
+    p->c++;
+    f = alternate(p, f, parse_concat(p));
+  }
+  return f;
+}
+
+/* @brief Splits the bytes into classes: two bytes are in the same class if
+ *        every set of the NFA has both or neither. */
+static void compute_byte_classes(dfa_t *dfa) {
+  uint32_t b, s;
+  memset(dfa->byte_class, 0, sizeof(dfa->byte_class));
+  dfa->class_count = 1;
+  for (s = 0; s < dfa->set_count; s++) {
+    int16_t remap[512];
+    memset(remap, -1, sizeof(remap));
+    uint32_t count = 0;
+    for (b = 0; b < 256; b++) {
+      uint32_t key = dfa->byte_class[b] * 2 + set_has(&dfa->sets[s], b);
+      if (remap[key] < 0) {
+        remap[key] = count++;
+      }
+      dfa->byte_class[b] = remap[key];
+    }
+    dfa->class_count = count;
+  }
+  for (b = 256; b-- > 0;) {
+    dfa->class_byte[dfa->byte_class[b]] = b;
+  }
+}
+
+static void dfa_free(dfa_t *dfa) {
+  if (!dfa) {
+    return;
+  }
+  uint32_t i;
+  for (i = 0; i < dfa->state_count; i++) {
+    free(dfa->states[i].nfa);
+    free(dfa->states[i].next);
+  }
+  free(dfa->nfa);
+  free(dfa->sets);
+  free(dfa->marks);
+  free(dfa->stack);
+  free(dfa->closure);
+  free(dfa);
+}
+
+static dfa_t *dfa_compile(const char *pattern) {
+  dfa_t *dfa = calloc(1, sizeof(dfa_t));
+  if (!dfa) {
+    return NULL;
+  }
+  parser_t p = { pattern, dfa, 0 };
+
+  dfa->fold_case = 1;
+  const char *c;
+  for (c = pattern; *c; c++) {
+    if (*c >= 'A' && *c <= 'Z') {
+      dfa->fold_case = 0;
+    }
+  }
+  fragment_t f = parse_alternation(&p);
+  if (*p.c) {
+    p.error = 1; /* An unbalanced ). */
+  }
+  uint32_t match = new_state(&p, NFA_MATCH, NO_STATE, NO_STATE, 0);
+  if (p.error) {
+    dfa_free(dfa);
+    return NULL;
+  }
+  patch(dfa, f.out, match);
+  dfa->start = f.start;
+  compute_byte_classes(dfa);
+
+  dfa->marks = calloc(dfa->nfa_count, sizeof(uint32_t));
+  dfa->stack = malloc(dfa->nfa_count * sizeof(uint32_t));
+  dfa->closure = malloc(dfa->nfa_count * sizeof(uint32_t));
+  if (!dfa->marks || !dfa->stack || !dfa->closure) {
+    dfa_free(dfa);
+    return NULL;
+  }
+  dfa->start_state = NO_STATE;
+  return dfa;
+}
+
+/* @brief Adds the NFA states reachable from state, without consuming, to the
+ *        closure being built (marked with the current generation).
+ *
+ * @param at_start If ^ holds.
+ * @param at_end If $ holds, else the NFA_END states are kept in the closure.
+ */
+static void add_closure(dfa_t *dfa, uint32_t state, uint32_t *count, int32_t at_start, int32_t at_end) {
+  uint32_t depth = 0;
+  dfa->stack[depth++] = state;
+  while (depth) {
+    uint32_t s = dfa->stack[--depth];
+    if (dfa->marks[s] == dfa->generation) {
+      continue;
+    }
+    dfa->marks[s] = dfa->generation;
+    nfa_state_t *n = &dfa->nfa[s];
+    if (n->type == NFA_SPLIT) {
+      dfa->stack[depth++] = n->out1;
+      dfa->stack[depth++] = n->out;
+    } else if (n->type == NFA_EMPTY || (n->type == NFA_BEGIN && at_start)
+               || (n->type == NFA_END && at_end)) {
+      dfa->stack[depth++] = n->out;
+    } else if (n->type != NFA_BEGIN) {
+      dfa->closure[(*count)++] = s;
+    }
+  }
+}
+
+static void next_generation(dfa_t *dfa) {
+  if (++dfa->generation == 0) {
+    memset(dfa->marks, 0, dfa->nfa_count * sizeof(uint32_t));
+    dfa->generation = 1;
+  }
+}
+
+static int compare_states(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void flush_states(dfa_t *dfa) {
+  uint32_t i;
+  for (i = 0; i < dfa->state_count; i++) {
+    free(dfa->states[i].nfa);
+    free(dfa->states[i].next);
+  }
+  dfa->state_count = 0;
+  dfa->flushes++;
+  dfa->start_state = NO_STATE;
+  memset(dfa->table, 0xFF, sizeof(dfa->table));
+}
+
+/* @brief Finds or adds the DFA state of the closure just built.
+ *
+ * @return Its index, or NO_STATE if out of memory.
+ */
+static uint32_t intern_closure(dfa_t *dfa, uint32_t count) {
+  qsort(dfa->closure, count, sizeof(uint32_t), compare_states);
+  uint32_t hash = 2166136261u;
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    hash = (hash ^ dfa->closure[i]) * 16777619u;
+  }
+
+  if (dfa->state_count == 0) {
+    memset(dfa->table, 0xFF, sizeof(dfa->table));
+  }
+  uint32_t size = MAX_DFA_STATES * 2;
+  uint32_t slot = hash & (size - 1);
+  while (dfa->table[slot] != NO_STATE) {
+    dfa_state_t *state = &dfa->states[dfa->table[slot]];
+    if (state->hash == hash && state->count == count
+        && !memcmp(state->nfa, dfa->closure, count * sizeof(uint32_t))) {
+      return dfa->table[slot];
+    }
+    slot = (slot + 1) & (size - 1);
+  }
+
+  if (dfa->state_count == MAX_DFA_STATES) {
+    /* Starts over: the states are rebuilt as the texts need them again. */
+    flush_states(dfa);
+    slot = hash & (size - 1);
+  }
+  dfa_state_t *state = &dfa->states[dfa->state_count];
+  state->nfa = malloc((count ? count : 1) * sizeof(uint32_t));
+  state->next = malloc(dfa->class_count * sizeof(uint32_t));
+  if (!state->nfa || !state->next) {
+    free(state->nfa);
+    free(state->next);
+    return NO_STATE;
+  }
+  memcpy(state->nfa, dfa->closure, count * sizeof(uint32_t));
+  memset(state->next, 0xFF, dfa->class_count * sizeof(uint32_t));
+  state->count = count;
+  state->hash = hash;
+  state->match = 0;
+  state->end_match = -1;
+  for (i = 0; i < count; i++) {
+    if (dfa->nfa[dfa->closure[i]].type == NFA_MATCH) {
+      state->match = 1;
+    }
+  }
+  dfa->table[slot] = dfa->state_count;
+  return dfa->state_count++;
+}
+
+static uint32_t start_state(dfa_t *dfa) {
+  if (dfa->start_state == NO_STATE) {
+    uint32_t count = 0;
+    next_generation(dfa);
+    add_closure(dfa, dfa->start, &count, 1, 0);
+    dfa->start_state = intern_closure(dfa, count);
+  }
+  return dfa->start_state;
+}
+
+/* @brief Builds the transition of a state on a byte class. */
+static uint32_t build_transition(dfa_t *dfa, uint32_t from, uint32_t byte_class) {
+  uint8_t byte = dfa->class_byte[byte_class];
+  uint32_t count = 0;
+  uint32_t i;
+  next_generation(dfa);
+  dfa_state_t *state = &dfa->states[from];
+  for (i = 0; i < state->count; i++) {
+    nfa_state_t *n = &dfa->nfa[state->nfa[i]];
+    if (n->type == NFA_SET && set_has(&dfa->sets[n->set], byte)) {
+      add_closure(dfa, n->out, &count, 0, 0);
+    }
+  }
+  /* A match may start at any byte. */
+  add_closure(dfa, dfa->start, &count, 0, 0);
+  uint32_t flushes = dfa->flushes;
+  uint32_t to = intern_closure(dfa, count);
+  /* Not kept if the states were just flushed, from is gone. */
+  if (to != NO_STATE && dfa->flushes == flushes) {
+    dfa->states[from].next[byte_class] = to;
+  }
+  return to;
+}
+
+/* @brief Tells if a state matches when the text ends there, past its $. */
+static int32_t end_match(dfa_t *dfa, dfa_state_t *state) {
+  if (state->end_match == -1) {
+    uint32_t count = 0;
+    uint32_t i;
+    next_generation(dfa);
+    for (i = 0; i < state->count; i++) {
+      if (dfa->nfa[state->nfa[i]].type == NFA_END) {
+        add_closure(dfa, state->nfa[i], &count, 0, 1);
+      }
+    }
+    state->end_match = 0;
+    for (i = 0; i < count; i++) {
+      if (dfa->nfa[dfa->closure[i]].type == NFA_MATCH) {
+        state->end_match = 1;
+      }
+    }
+  }
+  return state->match || state->end_match;
+}
+
+int32_t dfa_match(dfa_t *dfa, const char *text) {
+  uint32_t state = start_state(dfa);
+  if (state == NO_STATE) {
+    return 0;
+  }
+  const uint8_t *c;
+  for (c = (const uint8_t *)text; *c; c++) {
+    if (dfa->states[state].match) {
+      return 1;
+    }
+    if (!dfa->states[state].count) {
+      return 0; /* Dead: only ^ could start a match. */
+    }
+    uint32_t byte_class = dfa->byte_class[*c];
+    uint32_t next = dfa->states[state].next[byte_class];
+    if (next == NO_STATE) {
+      next = build_transition(dfa, state, byte_class);
+      if (next == NO_STATE) {
+        return 0;
+      }
+    }
+    state = next;
+  }
+  return end_match(dfa, &dfa->states[state]);
+}
+
+/* @brief The compiled patterns, by recency. */
+static struct {
+  char *pattern;
+  dfa_t *dfa;
+  uint64_t used;
+} dfa_cache[DFA_CACHE_SIZE];
+static uint64_t dfa_clock = 0;
+
+dfa_t *dfa_get(const char *pattern) {
+  uint32_t i, oldest = 0;
+  for (i = 0; i < DFA_CACHE_SIZE; i++) {
+    if (dfa_cache[i].pattern && !strcmp(dfa_cache[i].pattern, pattern)) {
+      dfa_cache[i].used = ++dfa_clock;
+      stats_add(STAT_DFA_CACHE_HITS, 1);
+      return dfa_cache[i].dfa;
+    }
+    if (dfa_cache[i].used < dfa_cache[oldest].used) {
+      oldest = i;
+    }
+  }
+
+  stats_add(STAT_DFA_CACHE_MISSES, 1);
+  dfa_t *dfa = dfa_compile(pattern);
+  char *copy = strdup(pattern);
+  if (!dfa || !copy) {
+    debug("Invalid pattern %s.\n", pattern);
+    dfa_free(dfa);
+    free(copy);
+    return NULL;
+  }
+  free(dfa_cache[oldest].pattern);
+  dfa_free(dfa_cache[oldest].dfa);
+  dfa_cache[oldest].pattern = copy;
+  dfa_cache[oldest].dfa = dfa;
+  dfa_cache[oldest].used = ++dfa_clock;
+  return dfa;
+}
@@ -11,6 +11,9 @@
 
 #include "display.h"
 #include "globals.h"
+#include "probes.h"
+#include "stats.h"
+#include "trace.h"
 
 #define min(a,b) ((a) < (b) ? (a) : (b))
 
@@ -352,6 +355,7 @@ static void draw_png(cairo_t *cr, draw_t *charac, offset_t *offset, uint32_t win
  * @return The advance in the x direction.
  */
 static image_format_t draw_image(cairo_t *cr, draw_t *charac, offset_t offset, uint32_t win_size_x, uint32_t win_size_y) {
+  uint64_t image_begin = trace_begin();
   wordexp_t expanded_file;
   image_format_t format = {0, 0};
 
@@ -365,6 +369,7 @@ static image_format_t draw_image(cairo_t *cr, draw_t *charac, offset_t offset, u
     fprintf(stderr, "Cannot open image file %s\n", charac->data);
     format.width = 0;
     format.height = 0;
+    trace_end(TRACE_IMAGE_DECODE, image_begin, 0);
     return format;
   }
 
@@ -394,6 +399,9 @@ static image_format_t draw_image(cairo_t *cr, draw_t *charac, offset_t offset, u
         break;
   }
   fclose(picture);
+  stats_add(STAT_IMAGES, 1);
+  PROBE3(image__decoded, charac->data, format.width, format.height);
+  trace_end(TRACE_IMAGE_DECODE, image_begin, format.width);
   return format;
 }
 
@@ -424,19 +432,16 @@ static void draw_line(cairo_t *cr, const char *text, uint32_t line, color_t *for
   pango_font_description_set_absolute_size(font_description, settings.font_size * PANGO_SCALE);
 #endif
 
-  modifier_type_t *modifiers_array = malloc(0);
-  /* Setting up the pointer that need to be used to stock the modifiers type.
-   * This one is created in this function for the ease of use:
-   *   It will only be freed when the entire string is parsed.
-   */
+  /* The modifiers opened so far in the text. */
+  modifier_stack_t modifiers = { .length = 0 };
 
   /* Parse the result line as we draw it. */
   char *c = (char *)text;
   while (c && *c != '\0') {
 #ifndef NO_PANGO
-    draw_t d = parse_result_line(cr, &c, settings.width - offset.x, &modifiers_array, font_description);
+    draw_t d = parse_result_line(cr, &c, settings.width - offset.x, &modifiers, font_description);
 #else
-    draw_t d = parse_result_line(cr, &c, settings.width - offset.x, &modifiers_array);
+    draw_t d = parse_result_line(cr, &c, settings.width - offset.x, &modifiers);
 #endif
     /* Checking if there are still char to draw. */ // TODO
     if (d.data == NULL)
@@ -467,7 +472,6 @@ static void draw_line(cairo_t *cr, const char *text, uint32_t line, color_t *for
 #ifndef NO_PANGO
   pango_font_description_free (font_description);
 #endif
-  free(modifiers_array);
   pthread_mutex_unlock(&global.draw_mutex);
 }
 
@@ -497,20 +501,27 @@ static void draw_desc(cairo_t *cr, const char *text, color_t *foreground, color_
   pango_font_description_set_absolute_size(font_description, settings.desc_font_size * PANGO_SCALE);
 #endif
 
-  modifier_type_t *modifiers_array = malloc(0);
-  /* Setting up the pointer that need to be used to stock the modifiers type.
-   * This one is created in this function for the ease of use:
-   *   It will only be freed when the entire string is parsed.
-   */
+  /* The modifiers opened so far in the text. */
+  modifier_stack_t modifiers = { .length = 0 };
 
   /* Parse the result line as we draw it. */
   char *c = (char *)text;
   while (c && *c != '\0') {
 #ifndef NO_PANGO
-    draw_t d = parse_result_line(cr, &c, settings.desc_size + settings.width - offset.x, &modifiers_array, font_description);
+    draw_t d = parse_result_line(cr, &c, settings.desc_size + settings.width - offset.x, &modifiers, font_description);
 #else
-    draw_t d = parse_result_line(cr, &c, settings.width - offset.x, &modifiers_array);
+    draw_t d = parse_result_line(cr, &c, settings.desc_size + settings.width - offset.x, &modifiers);
 #endif
+    if (d.data == NULL) {
+      /* Nothing fits in what's left of the line. */
+      if (offset.x <= settings.width + 2) {
+        break;
+      }
+      offset.x = settings.width;
+      offset.y += global.real_desc_font_size;
+      offset.image_y += global.real_desc_font_size;
+      continue;
+    }
     char saved = *c;
     *c = '\0';
 
@@ -562,16 +573,76 @@ static void draw_desc(cairo_t *cr, const char *text, color_t *foreground, color_
 #ifndef NO_PANGO
   pango_font_description_free (font_description);
 #endif
-  free(modifiers_array);
+  pthread_mutex_unlock(&global.draw_mutex);
+}
+
+void move_window(xcb_connection_t *connection, xcb_window_t window, uint32_t x, uint32_t y) {
+  if (!connection) {
+    return;
+  }
+  uint32_t values[] = { x, y };
+  xcb_configure_window(connection, window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
+}
+
+void resize_window(xcb_connection_t *connection, xcb_window_t window, cairo_surface_t *surface, uint32_t width, uint32_t height) {
+  if (!connection) {
+    return;
+  }
+  uint32_t values[] = { width, height };
+  xcb_configure_window(connection, window, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
+  if (cairo_surface_get_type(surface) == CAIRO_SURFACE_TYPE_XCB) {
+    cairo_xcb_surface_set_size(surface, width, height);
+  }
+}
+
+/* @brief Draw the debug HUD over the right end of the query line: the last
+ *        render time, the latency of the cmd for the last query, the last
+ *        parse time, the rows drawn by the last render, the images decoded,
+ *        and the hits/misses of the description cache and of the regex DFA
+ *        cache. The state of cr is restored after.
+ *
+ * @param cr A cairo context for drawing to the screen.
+ * @return Void.
+ */
+static void draw_hud(cairo_t *cr) {
+  char text[192];
+  snprintf(text, sizeof(text), "render %.2fms  cmd %.1fms  parse %.2fms  rows %u  img %u  desc %u/%u  re %u/%u",
+           stats_get(STAT_LAST_RENDER_NS) / 1e6, stats_get(STAT_LAST_BACKEND_NS) / 1e6,
+           stats_get(STAT_LAST_PARSE_NS) / 1e6, (uint32_t)stats_get(STAT_LAST_ROWS),
+           (uint32_t)stats_get(STAT_IMAGES),
+           (uint32_t)stats_get(STAT_DESC_CACHE_HITS), (uint32_t)stats_get(STAT_DESC_CACHE_MISSES),
+           (uint32_t)stats_get(STAT_DFA_CACHE_HITS), (uint32_t)stats_get(STAT_DFA_CACHE_MISSES));
+
+  pthread_mutex_lock(&global.draw_mutex);
+  /* The smaller font must not leak into the measurements of the query line. */
+  cairo_save(cr);
+  cairo_select_font_face(cr, settings.font_name, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size(cr, settings.font_size / 2 + 1);
+  cairo_text_extents_t extents;
+  cairo_text_extents(cr, text, &extents);
+  double x = settings.width - extents.x_advance - settings.horiz_padding;
+
+  /* Swap the query colors so it stands out from what is typed. */
+  cairo_set_source_rgb(cr, settings.query_fg.r, settings.query_fg.g, settings.query_fg.b);
+  cairo_rectangle(cr, x - settings.horiz_padding, 0, settings.width - x + settings.horiz_padding, settings.height / 2);
+  cairo_fill(cr);
+  cairo_set_source_rgb(cr, settings.query_bg.r, settings.query_bg.g, settings.query_bg.b);
+  cairo_move_to(cr, x, settings.height / 2 - 2);
+  cairo_show_text(cr, text);
+  cairo_restore(cr);
   pthread_mutex_unlock(&global.draw_mutex);
 }
 
 void draw_query_text(cairo_t *cr, cairo_surface_t *surface, const char *text, uint32_t cursor) {
   draw_typed_line(cr, (char *)text, 0, cursor, &settings.query_fg, &settings.query_bg);
+  if (global.show_hud) {
+    draw_hud(cr);
+  }
   cairo_surface_flush(surface);
 }
 
-void draw_result_text(xcb_connection_t *connection, xcb_window_t window, cairo_t *cr, cairo_surface_t *surface, result_t *results) {
+void draw_result_text(xcb_connection_t *connection, xcb_window_t window, cairo_t *cr, cairo_surface_t *surface, char *base, result_t *results) {
+  uint64_t render_begin = trace_now();
   int32_t line, index;
   if (global.result_count - 1 < global.result_highlight) {
     global.result_highlight = global.result_count - 1;
@@ -598,46 +669,69 @@ void draw_result_text(xcb_connection_t *connection, xcb_window_t window, cairo_t
   }
 
   if ((global.result_highlight < global.result_count) &&
-          results[global.result_highlight].desc) {
+          results[global.result_highlight].desc != NO_OFFSET) {
       if (settings.auto_center) {
-        uint32_t values[] = { global.win_x_pos_with_desc, global.win_y_pos };
-        xcb_configure_window(connection, window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
+        move_window(connection, window, global.win_x_pos_with_desc, global.win_y_pos);
       }
 
       uint32_t new_height = min(settings.height * (global.result_count + 1), settings.max_height);
-      uint32_t values[] = { settings.width+settings.desc_size, new_height };
-      xcb_configure_window(connection, window, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
-      cairo_xcb_surface_set_size(surface, settings.width + settings.desc_size, new_height);
-      draw_desc(cr, results[global.result_highlight].desc, &settings.highlight_fg, &settings.highlight_bg);
+      resize_window(connection, window, surface, settings.width + settings.desc_size, new_height);
+      /* A token stands for a description fetched from the cmd, see
+       * fetch_desc in child.c. Nothing is shown until it is there. */
+      const char *desc = base + results[global.result_highlight].desc;
+      const char *token;
+      uint32_t token_length;
+      if (parse_desc_token(desc, &token, &token_length)) {
+        desc = desc_cache_get(token, token_length);
+        if (!desc) {
+          desc = "";
+        }
+      }
+      draw_desc(cr, desc, &settings.highlight_fg, &settings.highlight_bg);
   } else {
       if (settings.auto_center) {
-        uint32_t values[] = { global.win_x_pos, global.win_y_pos };
-        xcb_configure_window(connection, window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
+        move_window(connection, window, global.win_x_pos, global.win_y_pos);
       }
 
       uint32_t new_height = min(settings.height * (global.result_count + 1), settings.max_height);
-      uint32_t values[] = { settings.width, new_height };
-      xcb_configure_window (connection, window, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
-      cairo_xcb_surface_set_size(surface, settings.width, new_height);
+      resize_window(connection, window, surface, settings.width, new_height);
   }
 
   for (index = global.result_offset, line = 1; index < global.result_offset + display_results; index++, line++) {
-    if (!(results[index].action)) {
+    uint64_t row_begin = trace_begin();
+    if (results[index].action == NO_OFFSET) {
       /* Title */
-      draw_line(cr, results[index].text, line, &settings.result_fg, &settings.result_bg);
+      draw_line(cr, base + results[index].text, line, &settings.result_fg, &settings.result_bg);
       /* TODO Add options for titles. */
     } else if (index != global.result_highlight) {
-      draw_line(cr, results[index].text, line, &settings.result_fg, &settings.result_bg);
+      draw_line(cr, base + results[index].text, line, &settings.result_fg, &settings.result_bg);
     } else {
-      draw_line(cr, results[index].text, line, &settings.highlight_fg, &settings.highlight_bg);
+      draw_line(cr, base + results[index].text, line, &settings.highlight_fg, &settings.highlight_bg);
     }
+    PROBE2(row__drawn, index, line);
+    trace_end(TRACE_LAYOUT_ROW, row_begin, index);
+  }
+  if (global.show_hud) {
+    draw_hud(cr);
   }
+  uint64_t flush_begin = trace_begin();
   cairo_surface_flush(surface);
-  xcb_flush(connection);
+  if (connection) {
+    xcb_flush(connection);
+  }
+  PROBE1(frame__presented, global.result_count);
+  trace_end(TRACE_FLUSH, flush_begin, 0);
+
+  uint64_t render_time = trace_now() - render_begin;
+  stats_add(STAT_RENDERS, 1);
+  stats_add(STAT_RENDER_NS, render_time);
+  stats_add(STAT_ROWS_DRAWN, line - 1);
+  stats_set(STAT_LAST_RENDER_NS, render_time);
+  stats_set(STAT_LAST_ROWS, line - 1);
 }
 
 void redraw_all(xcb_connection_t *connection, xcb_window_t window, cairo_t *cr, cairo_surface_t *surface, char *query_string, uint32_t query_cursor_index) {
   draw_query_text(cr, surface, query_string, query_cursor_index);
-  draw_result_text(connection, window, cr, surface, global.results);
+  draw_result_text(connection, window, cr, surface, global.result_base, global.results);
 }
 
@@ -0,0 +1,272 @@
+/** @file filter.c
+ *
+ *  @brief This file contains the local filters: queries starting with a
+ *         configured prefix are matched against the results already received,
+ *         in lighthouse, instead of being sent to the cmd.
+ *
+ *  The results shown (global.results) are then a filtered copy of those of
+ *  the frame (global.frame_results), pointing into the same frame. The fuzzy
+ *  filter splits the results among the workers of the scheduler, the boolean
+ *  one indexes the frame the first time it is queried.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dfa.h"
+#include "filter.h"
+#include "fuzzy.h"
+#include "globals.h"
+#include "postings.h"
+#include "results.h"
+#include "scheduler.h"
+
+/* @brief Results matched by a task of the scheduler. */
+#define FILTER_CHUNK      4096
+
+typedef enum {
+  FILTER_NONE,
+  FILTER_REGEX,
+  FILTER_FUZZY,
+  FILTER_BOOLEAN
+} filter_mode_t;
+
+/* @brief The filter applied, the query without its prefix. The last valid
+ *        regex is kept, to keep filtering while a pattern is being typed. */
+static filter_mode_t mode = FILTER_NONE;
+static char *pattern = NULL;
+static char *valid_pattern = NULL;
+
+/* @brief The results shown when filtering. */
+static result_t *filtered = NULL;
+
+/* @brief The edits of each result of the frame to the fuzzy pattern. */
+static uint8_t *edits = NULL;
+
+/* @brief The inverted index of the frame, NULL until the boolean filter
+ *        needs it, and the results it matched. */
+static postings_t *inverted = NULL;
+static uint32_t *matches = NULL;
+
+typedef struct {
+  const fuzzy_pattern_t *fuzzy;
+  uint32_t begin;
+  uint32_t end;
+} fuzzy_task_t;
+
+/* @brief Tells which filter a query is for.
+ *
+ * @param query The query.
+ * @param rest Set to what follows the prefix.
+ * @return The filter, FILTER_NONE if it is for the cmd.
+ */
+static filter_mode_t query_mode(const char *query, const char **rest) {
+  if (settings.regex_prefix && *settings.regex_prefix
+      && !strncmp(query, settings.regex_prefix, strlen(settings.regex_prefix))) {
+    *rest = query + strlen(settings.regex_prefix);
+    return FILTER_REGEX;
+  }
+  if (settings.fuzzy_prefix && *settings.fuzzy_prefix
+      && !strncmp(query, settings.fuzzy_prefix, strlen(settings.fuzzy_prefix))) {
+    *rest = query + strlen(settings.fuzzy_prefix);
+    return FILTER_FUZZY;
+  }
+  if (settings.boolean_prefix && *settings.boolean_prefix && !global.cmd_boolean
+      && !strncmp(query, settings.boolean_prefix, strlen(settings.boolean_prefix))) {
+    *rest = query + strlen(settings.boolean_prefix);
+    return FILTER_BOOLEAN;
+  }
+  return FILTER_NONE;
+}
+
+int32_t filter_active(void) {
+  return mode != FILTER_NONE;
+}
+
+/* @brief Keeps the results of the frame the regex matches (the titles are
+ *        left out).
+ *
+ * @return The number of results kept in filtered.
+ */
+static uint32_t filter_regex(void) {
+  dfa_t *dfa = dfa_get(pattern);
+  if (dfa) {
+    if (!valid_pattern || strcmp(valid_pattern, pattern)) {
+      free(valid_pattern);
+      valid_pattern = strdup(pattern);
+    }
+  } else if (valid_pattern) {
+    dfa = dfa_get(valid_pattern);
+  }
+
+  uint32_t count = 0;
+  uint32_t i;
+  for (i = 0; i < global.frame_count; i++) {
+    result_t *r = &global.frame_results[i];
+    if (r->action != NO_OFFSET && (!dfa || dfa_match(dfa, global.result_base + r->text))) {
+      filtered[count++] = *r;
+    }
+  }
+  return count;
+}
+
+/* @brief Computes the edits of a range of results, a task of the scheduler. */
+static void fuzzy_chunk(void *arg, sched_token_t *token) {
+  fuzzy_task_t *task = arg;
+  uint32_t i;
+  for (i = task->begin; i < task->end; i++) {
+    result_t *r = &global.frame_results[i];
+    uint32_t distance = UINT8_MAX;
+    if (r->action != NO_OFFSET) {
+      distance = fuzzy_distance(task->fuzzy, global.result_base + r->text);
+    }
+    edits[i] = distance < UINT8_MAX ? distance : UINT8_MAX;
+  }
+}
+
+/* @brief Keeps the results of the frame within the tolerated edits of the
+ *        pattern (the titles are left out), the closest first.
+ *
+ * @return The number of results kept in filtered.
+ */
+static uint32_t filter_fuzzy(void) {
+  static fuzzy_pattern_t fuzzy;
+  fuzzy_compile(&fuzzy, pattern, settings.fuzzy_edits);
+  uint32_t max_edits = fuzzy.max_edits < UINT8_MAX ? fuzzy.max_edits : UINT8_MAX - 1;
+
+  uint8_t *grown = realloc(edits, global.frame_count + 1);
+  if (!grown) {
+    return 0;
+  }
+  edits = grown;
+
+  uint32_t task_count = (global.frame_count + FILTER_CHUNK - 1) / FILTER_CHUNK;
+  fuzzy_task_t *tasks = malloc((task_count ? task_count : 1) * sizeof(fuzzy_task_t));
+  if (!tasks) {
+    return 0;
+  }
+  sched_token_t token = { 0, 0 };
+  uint32_t t;
+  for (t = 0; t < task_count; t++) {
+    tasks[t].fuzzy = &fuzzy;
+    tasks[t].begin = t * FILTER_CHUNK;
+    tasks[t].end = t == task_count - 1 ? global.frame_count : (t + 1) * FILTER_CHUNK;
+    if (task_count == 1 || scheduler_submit(fuzzy_chunk, &tasks[t], &token, SCHED_HIGH)) {
+      fuzzy_chunk(&tasks[t], NULL);
+    }
+  }
+  scheduler_wait(&token);
+  free(tasks);
+
+  /* Counting sort on the edits, keeping the order of the cmd for ties. */
+  uint32_t starts[UINT8_MAX + 1];
+  memset(starts, 0, sizeof(starts));
+  uint32_t i;
+  for (i = 0; i < global.frame_count; i++) {
+    if (edits[i] <= max_edits) {
+      starts[edits[i] + 1]++;
+    }
+  }
+  for (i = 1; i <= max_edits + 1; i++) {
+    starts[i] += starts[i - 1];
+  }
+  for (i = 0; i < global.frame_count; i++) {
+    if (edits[i] <= max_edits) {
+      filtered[starts[edits[i]]++] = global.frame_results[i];
+    }
+  }
+  return starts[max_edits];
+}
+
+/* @brief Keeps the results of the frame the boolean query matches (the
+ *        titles are left out), in their order.
+ *
+ * @return The number of results kept in filtered.
+ */
+static uint32_t filter_boolean(void) {
+  if (!inverted) {
+    inverted = postings_build(global.result_base, global.frame_results, global.frame_count);
+  }
+  uint32_t *grown = realloc(matches, (global.frame_count + 1) * sizeof(uint32_t));
+  if (!inverted || !grown) {
+    return 0;
+  }
+  matches = grown;
+  uint32_t count = postings_query(inverted, pattern, matches);
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    filtered[i] = global.frame_results[matches[i]];
+  }
+  return count;
+}
+
+/* @brief Applies the current filter to the results of the frame. */
+static void apply_filter(void) {
+  if (mode == FILTER_NONE || !global.frame_results) {
+    global.results = global.frame_results;
+    global.result_count = global.frame_count;
+    return;
+  }
+
+  result_t *grown = realloc(filtered, (global.frame_count + 1) * sizeof(result_t));
+  if (!grown) {
+    global.results = global.frame_results;
+    global.result_count = global.frame_count;
+    return;
+  }
+  filtered = grown;
+  uint32_t count = 0;
+  switch (mode) {
+    case FILTER_REGEX:
+      count = filter_regex();
+      break;
+    case FILTER_FUZZY:
+      count = filter_fuzzy();
+      break;
+    case FILTER_BOOLEAN:
+      count = filter_boolean();
+      break;
+    default:
+      break;
+  }
+  global.results = filtered;
+  global.result_count = count;
+}
+
+void filter_refresh(void) {
+  /* The index is of the previous frame. */
+  postings_free(inverted);
+  inverted = NULL;
+  apply_filter();
+}
+
+int32_t filter_query(const char *query) {
+  const char *rest = NULL;
+  filter_mode_t new_mode = query_mode(query, &rest);
+  if (new_mode == FILTER_NONE) {
+    if (mode != FILTER_NONE) {
+      mode = FILTER_NONE;
+      free(pattern);
+      pattern = NULL;
+      apply_filter();
+    }
+    return 0;
+  }
+
+  if (new_mode == mode && pattern && !strcmp(pattern, rest)) {
+    return 1;
+  }
+  char *copy = strdup(rest);
+  if (!copy) {
+    return 1;
+  }
+  free(pattern);
+  pattern = copy;
+  mode = new_mode;
+  global.result_highlight = 0;
+  global.result_offset = 0;
+  apply_filter();
+  return 1;
+}
@@ -0,0 +1,83 @@
+/** @file fuzzy.c
+ *
+ *  @brief This file contains the typo tolerant matching of the local filter:
+ *         the edit distance of a pattern to the best matching part of a
+ *         text, computed a column of the dynamic programming matrix at a time
+ *         in a few word operations (the pattern is at most 64 bytes).
+ *
+ *  See "A bit-vector algorithm for computing Levenshtein and Damerau edit
+ *  distances", Hyyro 2003. As a search, the first row is all zeros: a match
+ *  may start anywhere in the text.
+ */
+
+#include <string.h>
+
+#include "fuzzy.h"
+
+void fuzzy_compile(fuzzy_pattern_t *fuzzy, const char *pattern, uint32_t max_edits) {
+  memset(fuzzy->peq, 0, sizeof(fuzzy->peq));
+  size_t length = strlen(pattern);
+  if (length > FUZZY_MAX_LENGTH) {
+    length = FUZZY_MAX_LENGTH;
+  }
+  int32_t fold_case = 1;
+  uint32_t i;
+  for (i = 0; i < length; i++) {
+    if (pattern[i] >= 'A' && pattern[i] <= 'Z') {
+      fold_case = 0;
+    }
+  }
+  for (i = 0; i < length; i++) {
+    uint8_t c = pattern[i];
+    fuzzy->peq[c] |= 1ull << i;
+    if (fold_case && c >= 'a' && c <= 'z') {
+      fuzzy->peq[c - 'a' + 'A'] |= 1ull << i;
+    }
+  }
+  fuzzy->length = length;
+  if (!max_edits) {
+    /* None for a letter or two, then about one per three, up to three. */
+    max_edits = length < 3 ? 0 : length < 6 ? 1 : length < 10 ? 2 : 3;
+  }
+  fuzzy->max_edits = max_edits;
+}
+
+uint32_t fuzzy_distance(const fuzzy_pattern_t *fuzzy, const char *text) {
+  uint32_t m = fuzzy->length;
+  if (!m) {
+    return 0;
+  }
+  uint64_t mask = m == 64 ? ~0ull : (1ull << m) - 1;
+  uint64_t last = 1ull << (m - 1);
+  uint64_t vp = mask, vn = 0, d0 = 0, previous_eq = 0;
+  uint32_t score = m;
+  uint32_t best = m;
+
+  const uint8_t *c;
+  for (c = (const uint8_t *)text; *c; c++) {
+    uint64_t eq = fuzzy->peq[*c];
+    /* A swap: this byte matches where the previous one would have, and the
+     * other way round. */
+    d0 = (((~d0) & eq) << 1) & previous_eq;
+    d0 |= (((eq & vp) + vp) ^ vp) | eq | vn;
+    uint64_t hp = vn | ~(d0 | vp);
+    uint64_t hn = d0 & vp;
+    if (hp & last) {
+      score++;
+    } else if (hn & last) {
+      score--;
+    }
+    /* No carry in from the first row, it is all zeros. */
+    hp <<= 1;
+    vp = ((hn << 1) | ~(d0 | hp)) & mask;
+    vn = d0 & hp;
+    previous_eq = eq;
+    if (score < best) {
+      best = score;
+      if (!best) {
+        return 0;
+      }
+    }
+  }
+  return best;
+}
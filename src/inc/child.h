@@ -13,6 +13,15 @@
  */
 void *get_results(void *args);
 int32_t write_to_remote(FILE *child, char *format, ...);
+
+/* @brief Tells the results thread the highlight moved, so it fetches the
+ *        description of the new one when due (see settings.desc_dwell).
+ *
+ * @return Void.
+ */
+void wake_results(void);
 int32_t spawn_piped_process(char *file, int32_t *to_child_fd, int32_t *from_child_fd, char **argv);
+int32_t exec_action(const char *action);
+int32_t connect_backend(char *path, char *launch, int32_t *to_child_fd, int32_t *from_child_fd, char **argv);
 
 #endif /* _CHILD_H */
@@ -0,0 +1,31 @@
+#ifndef _DFA_H
+#define _DFA_H
+
+#include <stdint.h>
+
+/* @brief A compiled regular expression, matched with a lazy DFA. */
+typedef struct dfa_s dfa_t;
+
+/* @brief Returns the compiled form of a pattern, compiling it on first use.
+ *        The last patterns used stay compiled, with the DFA states built so
+ *        far, so editing a query back and forth reuses them.
+ *
+ * The syntax: literals, ., [classes], [^negated], \d \w \s (and \D \W \S),
+ * groups, |, *, + and ?, ^ and $ for the start and the end of the text. It is
+ * case insensitive unless the pattern has an upper case letter.
+ *
+ * @param pattern The pattern.
+ * @return The compiled pattern, owned by the cache, or NULL if it isn't valid.
+ */
+dfa_t *dfa_get(const char *pattern);
+
+/* @brief Tells if a text matches a pattern somewhere, in time linear in the
+ *        length of the text.
+ *
+ * @param dfa The compiled pattern.
+ * @param text The text, null terminated.
+ * @return 1 if it matches, else 0.
+ */
+int32_t dfa_match(dfa_t *dfa, const char *text);
+
+#endif /* _DFA_H */
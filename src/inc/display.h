@@ -31,17 +31,44 @@ void redraw_all(xcb_connection_t *connection, xcb_window_t window, cairo_t *cr,
 
 /* @brief Draw the results to the query.
  *
- * Note: the window may be resized in this function.
+ * Note: the window may be resized in this function. connection can be NULL
+ *       to draw offscreen (on an image surface).
  *
  * @param connection A connection to the Xorg server.
  * @param window An xcb window created by xcb_generate_id.
  * @param cr A cairo context for drawing to the screen.
  * @param surface A cairo surface for drawing to the screen.
+ * @param base The frame the results were parsed from.
  * @param results An array of results to be drawn.
- * @param result_count The number of results to be drawn.
  * @return Void.
  */
-void draw_result_text(xcb_connection_t *connection, xcb_window_t window, cairo_t *cr, cairo_surface_t *surface, result_t *results);
+void draw_result_text(xcb_connection_t *connection, xcb_window_t window, cairo_t *cr, cairo_surface_t *surface, char *base, result_t *results);
+
+/* @brief Moves the window.
+ *
+ * Note: nothing is done when connection is NULL (offscreen drawing).
+ *
+ * @param connection A connection to the Xorg server.
+ * @param window An xcb window created by xcb_generate_id.
+ * @param x The new x position.
+ * @param y The new y position.
+ * @return Void.
+ */
+void move_window(xcb_connection_t *connection, xcb_window_t window, uint32_t x, uint32_t y);
+
+/* @brief Resizes the window and the cairo surface drawing into it.
+ *
+ * Note: nothing is done when connection is NULL (offscreen drawing), the
+ *       surface is then expected to be big enough.
+ *
+ * @param connection A connection to the Xorg server.
+ * @param window An xcb window created by xcb_generate_id.
+ * @param surface A cairo surface for drawing to the screen.
+ * @param width The new width.
+ * @param height The new height.
+ * @return Void.
+ */
+void resize_window(xcb_connection_t *connection, xcb_window_t window, cairo_surface_t *surface, uint32_t width, uint32_t height);
 
 /* @brief Draw the query text (what is typed).
  *
@@ -0,0 +1,34 @@
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#include <stdint.h>
+
+/* @brief Filters the results of the last frame in lighthouse when the query
+ *        starts with the prefix of a local filter (see regex_prefix,
+ *        fuzzy_prefix and boolean_prefix), instead of sending it to the cmd.
+ *
+ * Note: the caller must hold global.result_mutex.
+ *
+ * @param query The query.
+ * @return 1 if the query is a local filter, the results shown are filtered.
+ *         0 if it isn't, the results of the frame are shown again.
+ */
+int32_t filter_query(const char *query);
+
+/* @brief Sets global.results to the results of the frame (global.frame_results)
+ *        that pass the current filter, or to all of them. Called when the
+ *        frame changes.
+ *
+ * Note: the caller must hold global.result_mutex.
+ *
+ * @return Void.
+ */
+void filter_refresh(void);
+
+/* @brief Tells if a local filter is applied.
+ *
+ * @return 1 if so, else 0.
+ */
+int32_t filter_active(void);
+
+#endif /* _FILTER_H */
@@ -0,0 +1,37 @@
+#ifndef _FUZZY_H
+#define _FUZZY_H
+
+#include <stdint.h>
+
+/* @brief Longest pattern matched, it fits in a machine word. */
+#define FUZZY_MAX_LENGTH  64
+
+/* @brief A pattern prepared for fuzzy_distance. */
+typedef struct {
+  uint64_t peq[256]; /* For each byte, the positions of the pattern it is at. */
+  uint32_t length;
+  uint32_t max_edits;
+} fuzzy_pattern_t;
+
+/* @brief Prepares a pattern. It is case insensitive unless it has an upper
+ *        case letter, and cut to FUZZY_MAX_LENGTH bytes.
+ *
+ * @param fuzzy The prepared pattern.
+ * @param pattern The pattern.
+ * @param max_edits The most edits tolerated, 0 to pick from the length.
+ * @return Void.
+ */
+void fuzzy_compile(fuzzy_pattern_t *fuzzy, const char *pattern, uint32_t max_edits);
+
+/* @brief Finds the best match of a pattern anywhere in a text, counting
+ *        insertions, deletions, substitutions and swaps of adjacent bytes as
+ *        an edit each (Myers' bit-parallel algorithm, with Hyyro's
+ *        transpositions).
+ *
+ * @param fuzzy The pattern.
+ * @param text The text, null terminated.
+ * @return The edits of the best match, compare it to fuzzy->max_edits.
+ */
+uint32_t fuzzy_distance(const fuzzy_pattern_t *fuzzy, const char *text);
+
+#endif /* _FUZZY_H */
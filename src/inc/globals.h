@@ -2,14 +2,12 @@
 #define _GLOBALS_H
 
 #include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <stdint.h>
 
 #include "results.h"
 
-/* @brief Size of the buffers. */
-#define MAX_CONFIG_SIZE   10 * 1024
-#define MAX_RESULT_SIZE   10 * 1024
-
 /* @brief Debugging utilities. */
 #ifdef DEBUG
 #define debug(...) fprintf(stdout, __VA_ARGS__)
@@ -38,10 +36,15 @@ typedef struct {
 struct global_s {
   pthread_mutex_t draw_mutex;
   pthread_mutex_t result_mutex;
-  char result_buf[MAX_RESULT_SIZE];
-  result_t *results;
-  char config_buf[MAX_CONFIG_SIZE];
+  result_t *results; /* Shown, the frame_results or a filtered copy (see filter.c). */
+  result_t *frame_results; /* Received from the cmd. */
+  uint32_t frame_count;
+  char *result_base; /* The frame the results point into. */
+  char *config_buf; /* The config file, mapped private, never unmapped. */
   uint32_t result_count;
+  uint32_t result_total; /* Results the cmd has, more than frame_count when paginated. */
+  uint32_t page_requested; /* Offset of the page asked for, 0 if none. */
+  int32_t cmd_boolean; /* The cmd answers boolean_prefix queries itself. */
   uint32_t result_highlight;
   uint32_t result_offset;
   int32_t child_pid;
@@ -51,8 +54,17 @@ struct global_s {
   uint32_t win_y_pos;
   double real_font_size;
   double real_desc_font_size;
+  int32_t show_hud; /* Toggled with CTRL-T, see draw_hud. */
+  FILE *to_child; /* Written with global.result_mutex held. */
+  uint64_t highlight_time; /* When the highlight last moved, see trace_now. */
 };
 
+/* @brief How the cmd writes its results, see the format setting. */
+typedef enum {
+  FORMAT_BRACES, /* { title | action | desc }..., a frame per line. */
+  FORMAT_JSONL /* A result per line, a frame ends with an empty line. */
+} frame_format_t;
+
 /* @brief A struct of settings that are set and used when the program starts. */
 struct settings_s {
   /* The color scheme. */
@@ -63,11 +75,27 @@ struct settings_s {
   color_t highlight_fg;
   color_t highlight_bg;
 
-  /* The process to pipe input to. */
+  /* The process to pipe input to, or unix:<path> for a backend listening
+   * there (started with cmd_launch if it doesn't). */
   char *cmd;
+  char *cmd_launch;
+
+  /* Limits of the cmd (and of a launched backend), see apply_cmd_limits. */
+  int32_t cmd_nice;
+  char *cmd_ionice; /* idle, best-effort[:level] or realtime[:level]. */
+  uint32_t cmd_cpu_limit; /* Seconds of CPU time, 0 for none. */
+  uint32_t cmd_memory_limit; /* Megabytes of address space, 0 for none. */
+  char *cmd_cgroup; /* A delegated cgroup v2 directory. */
+
+  /* Prefixes of the queries filtered in lighthouse, see filter.c. */
+  char *regex_prefix;
+  char *fuzzy_prefix;
+  char *boolean_prefix;
+  uint32_t fuzzy_edits; /* Edits tolerated by the fuzzy filter, 0 for automatic. */
 
   /* Options. */
   int backspace_exit;
+  int exec_actions; /* Run the selected action instead of printing it. */
 
   /* Font. */
   char *font_name;
@@ -106,9 +134,13 @@ struct settings_s {
   uint32_t desc_font_size;
 
   uint32_t line_gap; /* Gap between the line drawed by %L */
+
+  uint32_t threads; /* Workers of the scheduler, 0 for one per processor. */
+  uint32_t desc_dwell; /* Milliseconds on a result before fetching its description. */
+  frame_format_t format;
 };
 
-struct global_s global;
-struct settings_s settings;
+extern struct global_s global;
+extern struct settings_s settings;
 
 #endif /* _GLOBALS_H */
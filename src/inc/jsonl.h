@@ -0,0 +1,23 @@
+#ifndef _JSONL_H
+#define _JSONL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "results.h"
+
+/* @brief Parses a JSON Lines frame: one object per result, with the text,
+ *        action and desc members (strings), other members are skipped.
+ *        An object without an action is a title.
+ *
+ * note: As parse_result_text, the results point into the text, which is
+ *       modified in place, and they should be freed.
+ *
+ * @param text The text to be parsed.
+ * @param length The length of the text passed in (in bytes).
+ * @param results A reference to the results to be populated.
+ * @return Number of results parsed.
+ */
+uint32_t parse_result_jsonl(char *text, size_t length, result_t **results);
+
+#endif /* _JSONL_H */
@@ -0,0 +1,47 @@
+#ifndef _POSTINGS_H
+#define _POSTINGS_H
+
+#include <stdint.h>
+
+#include "results.h"
+
+/* @brief Most clauses of a boolean query, the next ones are ignored. */
+#define POSTINGS_MAX_CLAUSES  16
+
+/* @brief An inverted index of results: for each word, the sorted indices of
+ *        the results it is in. */
+typedef struct postings_s postings_t;
+
+/* @brief Indexes the words (letters and digits, case insensitive) of the
+ *        texts of results. Titles (without an action) aren't indexed.
+ *
+ * @param base The base of the offsets of the results.
+ * @param results The results.
+ * @param count The number of results.
+ * @return The index, or NULL if out of memory.
+ */
+postings_t *postings_build(char *base, const result_t *results, uint32_t count);
+
+/* @brief Frees an index.
+ *
+ * @param postings The index, may be NULL.
+ * @return Void.
+ */
+void postings_free(postings_t *postings);
+
+/* @brief Evaluates a boolean query: words separated by spaces must all be
+ *        there, `!word` must not be, `a|b` needs one of them. A word matches
+ *        the words it starts.
+ *
+ * The posting lists are intersected from the shortest, galloping in the
+ * longer ones, so the cost follows the rarest word of the query.
+ *
+ * @param postings The index.
+ * @param query The query.
+ * @param matches Set to the indices of the results matched, in order. It must
+ *        hold as many entries as results were indexed.
+ * @return The number of results matched.
+ */
+uint32_t postings_query(postings_t *postings, const char *query, uint32_t *matches);
+
+#endif /* _POSTINGS_H */
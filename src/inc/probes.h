@@ -0,0 +1,32 @@
+#ifndef _PROBES_H
+#define _PROBES_H
+
+/* @brief USDT probes for perf and bpftrace, in the "lighthouse" provider.
+ *
+ * A probe is a single nop until a tracer attaches to it. They are compiled in
+ * when <sys/sdt.h> is available (the Makefile defines HAVE_SDT), otherwise
+ * they expand to nothing.
+ *
+ *   query__send(query, length)            a query was written to the cmd.
+ *   parse__done(result_count)             a frame was parsed.
+ *   frame__received(bytes, result_count)  a frame replaced the results.
+ *   row__drawn(index, line)               a result row was drawn.
+ *   image__decoded(path, width, height)   an image was loaded and drawn.
+ *   frame__presented(result_count)        the results were flushed to X.
+ *
+ * Example: bpftrace -e 'usdt:./lighthouse:lighthouse:frame__received { @bytes = hist(arg0); }'
+ */
+
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+
+#define PROBE1(name, a)       DTRACE_PROBE1(lighthouse, name, a)
+#define PROBE2(name, a, b)    DTRACE_PROBE2(lighthouse, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(lighthouse, name, a, b, c)
+#else
+#define PROBE1(name, a)       do {} while (0)
+#define PROBE2(name, a, b)    do {} while (0)
+#define PROBE3(name, a, b, c) do {} while (0)
+#endif
+
+#endif /* _PROBES_H */
@@ -1,6 +1,7 @@
 #ifndef _RESULTS_H
 #define _RESULTS_H
 
+#include <stdint.h>
 #include <cairo/cairo.h>
 #include <cairo/cairo-xcb.h>
 #ifndef NO_PANGO
@@ -32,6 +33,17 @@ typedef enum {
   BOLD
 } modifier_type_t;
 
+/* @brief Deepest nesting of modifiers that is kept, deeper ones are ignored. */
+#define MAX_MODIFIERS     16
+
+/* @brief The modifiers opened so far in a text, owned by the caller of
+ *        parse_result_line and zeroed before parsing each text.
+ */
+typedef struct {
+  modifier_type_t modifiers[MAX_MODIFIERS];
+  uint32_t length; /* May exceed MAX_MODIFIERS, so the closing '%' still match. */
+} modifier_stack_t;
+
 /* @brief Type used to pass around drawing options. */
 typedef struct {
   draw_type_t type;
@@ -41,13 +53,35 @@ typedef struct {
   uint32_t data_length; /* Not always filled */
 } draw_t;
 
-/* @brief Type used to maintain a list of results in a usable form. */
+/* @brief Marks a missing action or description in a result_t. */
+#define NO_OFFSET         UINT32_MAX
+
+/* @brief Type used to maintain a list of results in a usable form.
+ *
+ * The fields are offsets of null terminated strings in the frame the results
+ * were parsed from, use result_string to get them, each with its length (set
+ * by intern_results, 0 for NO_OFFSET). Equal actions (and descriptions) are
+ * stored once in the frame and share their offset.
+ */
 typedef struct {
-  char *text;
-  char *action;
-  char *desc;
+  uint32_t text;
+  uint32_t action;
+  uint32_t desc;
+  uint32_t text_length;
+  uint32_t action_length;
+  uint32_t desc_length;
 } result_t;
 
+/* @brief Returns a string of a result.
+ *
+ * @param base The frame the result was parsed from.
+ * @param offset A field of the result.
+ * @return The string, or NULL for NO_OFFSET.
+ */
+static inline char *result_string(char *base, uint32_t offset) {
+  return offset == NO_OFFSET ? NULL : base + offset;
+}
+
 /* @brief This struct is exclusively used to spawn a thread. */
 struct result_params {
   cairo_t *cr;
@@ -58,10 +92,45 @@ struct result_params {
 };
 
 #ifndef NO_PANGO
-draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_type_t **modifiers_array, PangoFontDescription *font_description);
+draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_stack_t *modifiers, PangoFontDescription *font_description);
 #else
-draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_type_t **modifiers_array);
+draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_stack_t *modifiers);
 #endif
 uint32_t parse_result_text(char *text, size_t length, result_t **results);
 
+/* @brief Compacts the strings of parsed results in place: the texts one after
+ *        the other, then each action (and description) only the first time
+ *        it is seen, the results using it again point at that copy.
+ *
+ * @param text The parsed frame.
+ * @param length The length of the frame.
+ * @param results The results, their offsets and lengths are updated.
+ * @param count The number of results.
+ * @return The length of the compacted frame, text[length] is still the
+ *         terminator of the last string.
+ */
+size_t intern_results(char *text, size_t length, result_t *results, uint32_t count);
+
+uint32_t parse_page_header(const char *text, uint32_t *total, uint32_t *offset);
+uint32_t parse_desc_token(const char *text, const char **token, uint32_t *length);
+
+/* @brief Returns the description fetched for a token, or NULL.
+ *
+ * Note: the caller must hold global.result_mutex, as for desc_cache_put.
+ *
+ * @param token The token.
+ * @param length The length of the token.
+ * @return The description, valid until the next desc_cache_put.
+ */
+const char *desc_cache_get(const char *token, uint32_t length);
+
+/* @brief Keeps a copy of the description fetched for a token.
+ *
+ * @param token The token.
+ * @param length The length of the token.
+ * @param desc The description.
+ * @return Void.
+ */
+void desc_cache_put(const char *token, uint32_t length, const char *desc);
+
 #endif /* _RESULTS_H */
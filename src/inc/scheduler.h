@@ -0,0 +1,74 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <stdint.h>
+
+/* @brief Priority of a task, all the SCHED_HIGH tasks (the visible frame) are
+ *        run before any SCHED_LOW one. */
+typedef enum {
+  SCHED_HIGH,
+  SCHED_LOW,
+  SCHED_PRIORITIES
+} sched_priority_t;
+
+/* @brief Groups tasks so they can be cancelled and waited for together.
+ *        Zero it before use, it must outlive its tasks. */
+typedef struct {
+  int32_t cancelled;
+  uint32_t pending;
+} sched_token_t;
+
+/* @brief A task, it should check scheduler_cancelled(token) if it runs long. */
+typedef void (*sched_fn_t)(void *arg, sched_token_t *token);
+
+/* @brief Sets the scheduler up. The worker threads are started by the
+ *        first scheduler_submit, so none runs until there is work.
+ *
+ * @param threads Number of workers, 0 for one per processor.
+ * @return 0 on success and 1 on failure.
+ */
+int32_t scheduler_start(uint32_t threads);
+
+/* @brief Queues a task, starting the workers the first time. It runs on the
+ *        calling thread if the scheduler isn't set up or no worker started.
+ *
+ * A worker pushes to its own deque and pops the most recent task first, idle
+ * workers steal the oldest tasks from the others.
+ *
+ * @param fn The task.
+ * @param arg Passed to fn.
+ * @param token The group of the task, or NULL.
+ * @param priority SCHED_HIGH or SCHED_LOW.
+ * @return 0 on success and 1 on failure.
+ */
+int32_t scheduler_submit(sched_fn_t fn, void *arg, sched_token_t *token, sched_priority_t priority);
+
+/* @brief Cancels the tasks of a group: those not started yet are skipped.
+ *
+ * @param token The group.
+ * @return Void.
+ */
+void scheduler_cancel(sched_token_t *token);
+
+/* @brief Returns 1 if the group was cancelled, for tasks to stop early.
+ *
+ * @param token The group, may be NULL.
+ * @return 1 if cancelled, else 0.
+ */
+int32_t scheduler_cancelled(sched_token_t *token);
+
+/* @brief Waits until every task of the group has run or been skipped.
+ *
+ * @param token The group.
+ * @return Void.
+ */
+void scheduler_wait(sched_token_t *token);
+
+/* @brief Stops and joins the workers, queued tasks are dropped: they count as
+ *        done for their groups, so scheduler_wait returns.
+ *
+ * @return Void.
+ */
+void scheduler_stop(void);
+
+#endif /* _SCHEDULER_H */
@@ -0,0 +1,61 @@
+#ifndef _SESSION_H
+#define _SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+/* @brief A session file starts with this line, followed by records:
+ *
+ *   K <microseconds> <keycode> <state>\n          a key release.
+ *   F <microseconds> <length>\n<length bytes>\n   bytes read from the cmd.
+ *
+ * The time is counted from the start of the session.
+ */
+#define SESSION_HEADER "lighthouse-session 1\n"
+
+/* @brief Starts recording the session to a file.
+ *
+ * @param path The file to write.
+ * @return 0 on success and 1 on failure.
+ */
+int32_t session_record_open(const char *path);
+
+/* @brief Records a key release (does nothing if not recording).
+ *
+ * @param keycode The keycode of the event.
+ * @param state The modifier mask of the event.
+ * @return Void.
+ */
+void session_record_key(uint8_t keycode, uint16_t state);
+
+/* @brief Records bytes read from the cmd (does nothing if not recording).
+ *
+ * @param data The bytes read.
+ * @param length The number of bytes.
+ * @return Void.
+ */
+void session_record_frame(const char *data, size_t length);
+
+/* @brief Flushes and closes the session file.
+ *
+ * @return Void.
+ */
+void session_record_close(void);
+
+/* @brief Replays a recorded session in a new thread.
+ *
+ * The frames are written to frame_fd (the read end is used in place of the
+ * cmd's standard out) and the keys are sent as events to the window, so both
+ * go through the normal paths.
+ *
+ * @param path The session file.
+ * @param fast 1 to replay as fast as possible, 0 to keep the original timing.
+ * @param frame_fd Where to write the frames, closed at the end of the replay.
+ * @param connection A connection to the Xorg server.
+ * @param window The lighthouse window.
+ * @return 0 on success and 1 on failure.
+ */
+int32_t session_replay_start(const char *path, int32_t fast, int32_t frame_fd, xcb_connection_t *connection, xcb_window_t window);
+
+#endif /* _SESSION_H */
@@ -0,0 +1,86 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+
+/* @brief Statistics kept while running, see stat_info in stats.c.
+ *        The *_NS ones are in nanoseconds, the LAST_* ones are gauges. */
+typedef enum {
+  STAT_QUERIES,
+  STAT_FRAMES,
+  STAT_BYTES_READ,
+  STAT_RESULTS,
+  STAT_PARSE_NS,
+  STAT_RENDERS,
+  STAT_RENDER_NS,
+  STAT_ROWS_DRAWN,
+  STAT_IMAGES,
+  STAT_FRAMES_DROPPED,
+  STAT_DESC_CACHE_HITS,
+  STAT_DESC_CACHE_MISSES,
+  STAT_DFA_CACHE_HITS,
+  STAT_DFA_CACHE_MISSES,
+  STAT_LAST_PARSE_NS,
+  STAT_LAST_RENDER_NS,
+  STAT_LAST_BACKEND_NS,
+  STAT_LAST_ROWS,
+  STAT_COUNT
+} stat_t;
+
+/* @brief Adds to a counter, from any thread.
+ *
+ * @param stat The counter.
+ * @param value What to add.
+ * @return Void.
+ */
+void stats_add(stat_t stat, uint64_t value);
+
+/* @brief Sets a gauge, from any thread.
+ *
+ * @param stat The gauge.
+ * @param value The new value.
+ * @return Void.
+ */
+void stats_set(stat_t stat, uint64_t value);
+
+/* @brief Reads a counter or gauge.
+ *
+ * @param stat The counter or gauge.
+ * @return Its value.
+ */
+uint64_t stats_get(stat_t stat);
+
+/* @brief Marks a query as sent, the next stats_frame_received gives the
+ *        backend latency.
+ *
+ * @return Void.
+ */
+void stats_query_sent(void);
+
+/* @brief Counts a frame received from the cmd.
+ *
+ * @param bytes The size of the frame.
+ * @param results The number of results parsed from it.
+ * @return Void.
+ */
+void stats_frame_received(uint64_t bytes, uint32_t results);
+
+/* @brief Prints all the statistics, plus the memory used and the bytes
+ *        waiting in the pipes, to stderr.
+ *
+ * @return Void.
+ */
+void stats_dump(void);
+
+/* @brief Dumps the statistics each time SIGUSR1 is received.
+ *
+ * Note: call it before spawning the other threads, they need to inherit
+ *       the blocked SIGUSR1.
+ *
+ * @param from_child_fd The fd the results are read from.
+ * @param to_child_fd The fd the queries are written to.
+ * @return 0 on success and 1 on failure.
+ */
+int32_t stats_start(int32_t from_child_fd, int32_t to_child_fd);
+
+#endif /* _STATS_H */
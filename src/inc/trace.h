@@ -0,0 +1,73 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+/* @brief Spans that can be traced, see trace_names in trace.c. */
+typedef enum {
+  TRACE_EVENT_WAIT,
+  TRACE_KEY,
+  TRACE_CHILD_WRITE,
+  TRACE_READ,
+  TRACE_PARSE,
+  TRACE_LAYOUT_ROW,
+  TRACE_IMAGE_DECODE,
+  TRACE_FLUSH,
+  TRACE_SPAN_COUNT
+} trace_span_t;
+
+/* @brief Set to 1 by trace_start, everything else is a no-op while it is 0. */
+extern int32_t trace_enabled;
+
+/* @brief Returns a monotonic time in nanoseconds. */
+uint64_t trace_now(void);
+
+/* @brief Records a span into the buffer of the calling thread. */
+void trace_record(trace_span_t span, uint64_t begin, uint64_t end, uint32_t arg);
+
+/* @brief Starts a span.
+ *
+ * @return The start time, or 0 when tracing is disabled.
+ */
+static inline uint64_t trace_begin(void) {
+  return trace_enabled ? trace_now() : 0;
+}
+
+/* @brief Ends a span started by trace_begin.
+ *
+ * @param span What was done.
+ * @param begin The value returned by trace_begin.
+ * @param arg A number shown with the span (a row index, a size...).
+ * @return Void.
+ */
+static inline void trace_end(trace_span_t span, uint64_t begin, uint32_t arg) {
+  if (begin) {
+    trace_record(span, begin, trace_now(), arg);
+  }
+}
+
+/* @brief Enables tracing. The trace is written to path at exit and each time
+ *        SIGUSR2 is received.
+ *
+ * Note: call it before spawning the other threads, they need to inherit
+ *       the blocked SIGUSR2.
+ *
+ * @param path The file to write the trace to.
+ * @return 0 on success and 1 on failure.
+ */
+int32_t trace_start(const char *path);
+
+/* @brief Names the calling thread in the trace.
+ *
+ * @param name The name, it must live as long as the program.
+ * @return Void.
+ */
+void trace_thread_name(const char *name);
+
+/* @brief Writes the trace as Chrome trace-event JSON (chrome://tracing, Perfetto).
+ *
+ * @return 0 on success and 1 on failure.
+ */
+int32_t trace_dump(void);
+
+#endif /* _TRACE_H */
@@ -0,0 +1,288 @@
+/** @file jsonl.c
+ *
+ *  @brief This file contains the parser of the JSON Lines frames (see the
+ *         format setting): one object per result, on its own line.
+ *
+ *  The strings are used in place: the closing quote becomes the null
+ *  terminator, and only strings with escapes are rewritten, in place too
+ *  (unescaped, a string is never longer than it was escaped).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "jsonl.h"
+#include "results.h"
+
+typedef struct {
+  char *text;
+  uint32_t index;
+  uint32_t length;
+} json_cursor_t;
+
+static inline void skip_whitespace(json_cursor_t *json) {
+  while (json->index < json->length) {
+    char c = json->text[json->index];
+    if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+      return;
+    }
+    json->index++;
+  }
+}
+
+static inline char peek(json_cursor_t *json) {
+  return json->index < json->length ? json->text[json->index] : '\0';
+}
+
+/* @brief Parses 4 hexadecimal digits.
+ *
+ * @return The value, or -1 if they aren't hexadecimal digits.
+ */
+static int32_t parse_hex4(const char *c) {
+  int32_t value = 0;
+  uint32_t i;
+  for (i = 0; i < 4; i++) {
+    value <<= 4;
+    if (c[i] >= '0' && c[i] <= '9') {
+      value |= c[i] - '0';
+    } else if (c[i] >= 'a' && c[i] <= 'f') {
+      value |= c[i] - 'a' + 10;
+    } else if (c[i] >= 'A' && c[i] <= 'F') {
+      value |= c[i] - 'A' + 10;
+    } else {
+      return -1;
+    }
+  }
+  return value;
+}
+
+/* @brief Writes a code point in UTF-8.
+ *
+ * @return The number of bytes written.
+ */
+static uint32_t write_utf8(char *out, uint32_t code) {
+  if (code < 0x80) {
+    out[0] = code;
+    return 1;
+  } else if (code < 0x800) {
+    out[0] = 0xC0 | (code >> 6);
+    out[1] = 0x80 | (code & 0x3F);
+    return 2;
+  } else if (code < 0x10000) {
+    out[0] = 0xE0 | (code >> 12);
+    out[1] = 0x80 | ((code >> 6) & 0x3F);
+    out[2] = 0x80 | (code & 0x3F);
+    return 3;
+  }
+  out[0] = 0xF0 | (code >> 18);
+  out[1] = 0x80 | ((code >> 12) & 0x3F);
+  out[2] = 0x80 | ((code >> 6) & 0x3F);
+  out[3] = 0x80 | (code & 0x3F);
+  return 4;
+}
+
+/* @brief Parses a string in place, the cursor is on the opening quote.
+ *
+ * @param json The cursor, moved past the closing quote.
+ * @param offset Set to the offset of the (null terminated) string.
+ * @return 0 on success and 1 on a syntax error.
+ */
+static int32_t parse_string(json_cursor_t *json, uint32_t *offset) {
+  char *start = json->text + json->index + 1;
+  /* Common case, nothing to unescape: the bytes stay where they are. */
+  char *c = start + strcspn(start, "\"\\");
+  char *out = c;
+  while (*c != '"') {
+    if (*c != '\\') {
+      if (*c == '\0') {
+        return 1;
+      }
+      *out++ = *c++;
+      continue;
+    }
+    c++;
+    switch (*c) {
+      case '"': case '\\': case '/':
+        *out++ = *c++;
+        break;
+      case 'b': *out++ = '\b'; c++; break;
+      case 'f': *out++ = '\f'; c++; break;
+      case 'n': *out++ = '\n'; c++; break;
+      case 'r': *out++ = '\r'; c++; break;
+      case 't': *out++ = '\t'; c++; break;
+      case 'u': {
+        int32_t code = parse_hex4(c + 1);
+        if (code < 0) {
+          return 1;
+        }
+        c += 5;
+        if (code >= 0xD800 && code < 0xDC00 && c[0] == '\\' && c[1] == 'u') {
+          int32_t low = parse_hex4(c + 2);
+          if (low >= 0xDC00 && low < 0xE000) {
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            c += 6;
+          }
+        }
+        if (code == 0 || (code >= 0xD800 && code < 0xE000)) {
+          code = 0xFFFD; /* Would end the string, or isn't valid UTF-8. */
+        }
+        out += write_utf8(out, code);
+        break;
+      }
+      default:
+        return 1;
+    }
+  }
+  *out = '\0';
+  *offset = start - json->text;
+  json->index = c + 1 - json->text;
+  return 0;
+}
+
+/* @brief Skips a value other than a string: a number, a literal, an array
+ *        or an object (nested values aren't used by lighthouse).
+ *
+ * @return 0 on success and 1 on a syntax error.
+ */
+static int32_t skip_value(json_cursor_t *json) {
+  uint32_t offset;
+  char c = peek(json);
+  if (c == '"') {
+    return parse_string(json, &offset);
+  } else if (c == '{' || c == '[') {
+    uint32_t depth = 0;
+    do {
+      c = peek(json);
+      if (c == '"') {
+        if (parse_string(json, &offset)) {
+          return 1;
+        }
+        continue;
+      } else if (c == '{' || c == '[') {
+        depth++;
+      } else if (c == '}' || c == ']') {
+        depth--;
+      } else if (c == '\0') {
+        return 1;
+      }
+      json->index++;
+    } while (depth);
+    return 0;
+  } else if (!strncmp(json->text + json->index, "true", 4)
+             || !strncmp(json->text + json->index, "null", 4)) {
+    json->index += 4;
+    return 0;
+  } else if (!strncmp(json->text + json->index, "false", 5)) {
+    json->index += 5;
+    return 0;
+  }
+  uint32_t begin = json->index;
+  while (json->index < json->length && strchr("+-0123456789.eE", json->text[json->index])) {
+    json->index++;
+  }
+  return json->index == begin;
+}
+
+/* @brief Parses an object, the cursor is on the opening brace.
+ *
+ * @param json The cursor, moved past the closing brace.
+ * @param result Set to the text, action and desc members.
+ * @return 0 on success and 1 on a syntax error.
+ */
+static int32_t parse_object(json_cursor_t *json, result_t *result) {
+  *result = (result_t){ NO_OFFSET, NO_OFFSET, NO_OFFSET, 0, 0, 0 };
+  json->index++;
+  skip_whitespace(json);
+  if (peek(json) == '}') {
+    json->index++;
+    return 0;
+  }
+  while (1) {
+    uint32_t key;
+    if (peek(json) != '"' || parse_string(json, &key)) {
+      return 1;
+    }
+    skip_whitespace(json);
+    if (peek(json) != ':') {
+      return 1;
+    }
+    json->index++;
+    skip_whitespace(json);
+
+    const char *name = json->text + key;
+    uint32_t *member = NULL;
+    if (!strcmp(name, "text")) {
+      member = &result->text;
+    } else if (!strcmp(name, "action")) {
+      member = &result->action;
+    } else if (!strcmp(name, "desc")) {
+      member = &result->desc;
+    }
+    /* Anything else (id, score...) is for the cmd's own use. */
+    if (member && peek(json) == '"') {
+      if (parse_string(json, member)) {
+        return 1;
+      }
+    } else if (skip_value(json)) {
+      return 1;
+    }
+
+    skip_whitespace(json);
+    char c = peek(json);
+    json->index++;
+    if (c == '}') {
+      return 0;
+    } else if (c != ',') {
+      return 1;
+    }
+    skip_whitespace(json);
+  }
+}
+
+uint32_t parse_result_jsonl(char *text, size_t length, result_t **results) {
+  if (length >= NO_OFFSET) {
+    fprintf(stderr, "Frame too large: %zu bytes.\n", length);
+    return 0;
+  }
+  json_cursor_t json = { text, 0, length };
+  uint32_t count = 0;
+  uint32_t capacity = 16;
+  result_t *ret = malloc(capacity * sizeof(result_t));
+  if (!ret) {
+    return 0;
+  }
+
+  while (1) {
+    skip_whitespace(&json);
+    if (peek(&json) == '\0') {
+      break;
+    }
+    if (count == capacity) {
+      capacity *= 2;
+      result_t *grown = realloc(ret, capacity * sizeof(result_t));
+      if (!grown) {
+        break;
+      }
+      ret = grown;
+    }
+    uint32_t begin = json.index;
+    if (peek(&json) != '{' || parse_object(&json, &ret[count])) {
+      fprintf(stderr, "Syntax error in the result at index %u.\n", begin);
+      free(ret);
+      return 0;
+    }
+    if (ret[count].text == NO_OFFSET) {
+      fprintf(stderr, "Result without a text at index %u.\n", begin);
+      continue;
+    }
+    if (ret[count].action == NO_OFFSET) {
+      /* A title, as { title } in the other format. */
+      ret[count].desc = NO_OFFSET;
+    }
+    count++;
+  }
+  *results = ret;
+  return count;
+}
@@ -29,7 +29,7 @@
  *
  */
 
-#define _POSIX_SOURCE
+#define _POSIX_C_SOURCE 200809L
 
 #include <ctype.h>
 #include <errno.h>
@@ -39,16 +39,25 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include <wordexp.h>
 #include <xcb_keysyms.h>  /* xcb_key_symbols_alloc, xcb_key_press_lookup_keysym */
 
 #include "child.h"
 #include "display.h"
+#include "filter.h"
 #include "globals.h"
 #include "results.h"
+#include "probes.h"
+#include "scheduler.h"
+#include "session.h"
+#include "stats.h"
+#include "trace.h"
 
 /* declared in <string.h>, but not unless you define a suitable macro. Not sure which macro
    (see `man strdup`) is correct for this situation. */
@@ -64,6 +73,15 @@ extern char *strdup (const char *__s);
 #define HORIZ_PADDING     5
 #define CURSOR_PADDING    4
 
+/* @brief How long the cmd has to exit after SIGTERM before it gets SIGKILL. */
+#define KILL_TIMEOUT_MS   500
+
+/* @brief Prefix of a cmd that is a backend listening on a unix socket. */
+#define UNIX_PREFIX       "unix:"
+
+/* @brief Sent to the cmd, followed by an offset, to get the next page. */
+#define PAGE_REQUEST      "\033page "
+
 /* @brief Name of the file to search for. Directory appended at runtime. */
 #define CONFIG_FILE       "/lighthouse/lighthouserc"
 
@@ -124,7 +142,7 @@ uint8_t get_modifiers (uint32_t mask) {
  */
 static void get_next_non_title(uint32_t *highlight) {
     (*highlight)++;
-    while ((*highlight) < global.result_count && !global.results[*highlight].action) {
+    while ((*highlight) < global.result_count && global.results[*highlight].action == NO_OFFSET) {
         /* Searching for the next result with an action.*/
         (*highlight)++;
     }
@@ -152,14 +170,14 @@ static void get_next_line(uint32_t *highlight) {
  * @param Copy of the global.result_highlight for the ease of use.
  */
 static void next_title(uint32_t *highlight) {
-  while (*highlight < global.result_count && global.results[*highlight].action) {
+  while (*highlight < global.result_count && global.results[*highlight].action != NO_OFFSET) {
     (*highlight)++;
   }
   if (*highlight == global.result_count) {
     /* highlight hit the bottom. */
     *highlight = 0;
     global.result_offset = 0;
-    while (*highlight < global.result_count - 1 && global.results[*highlight].action) {
+    while (*highlight < global.result_count - 1 && global.results[*highlight].action != NO_OFFSET) {
       (*highlight)++;
     }
   }
@@ -173,7 +191,7 @@ static void next_title(uint32_t *highlight) {
  */
 static void get_previous_non_title(uint32_t *highlight) {
     (*highlight)--;
-    while ((*highlight) < global.result_count && !global.results[*highlight].action) {
+    while ((*highlight) < global.result_count && global.results[*highlight].action == NO_OFFSET) {
         /* Searching for the previous result with an action.
          *
          * *(*highlight) < global.result_count is used because I use highlight is
@@ -204,14 +222,14 @@ static void get_previous_line(uint32_t *highlight) {
  * @param Copy of the global.result_highlight for the ease of use.
  */
 static void previous_title(uint32_t *highlight) {
-    while (*highlight > 0 && global.results[*highlight].action) {
+    while (*highlight > 0 && global.results[*highlight].action != NO_OFFSET) {
       (*highlight)--;
     }
 
-    if (*highlight == 0 && global.results[*highlight].action) {
+    if (*highlight == 0 && global.results[*highlight].action != NO_OFFSET) {
         /* highlight hit the top . */
         *highlight = global.result_count - 1;
-        while (*highlight > 0 && global.results[*highlight].action) {
+        while (*highlight > 0 && global.results[*highlight].action != NO_OFFSET) {
           (*highlight)--;
         }
     }
@@ -219,6 +237,75 @@ static void previous_title(uint32_t *highlight) {
 }
 
 
+/* @brief Asks the cmd for the next page of results when the highlight gets
+ *        within a screen of the last loaded one (see parse_page_header).
+ *
+ * Note: the caller must hold global.result_mutex.
+ *
+ * @param to_write A descriptor to write to the child process.
+ * @return Void.
+ */
+static void request_next_page(FILE *to_write) {
+  uint32_t visible = settings.max_height / settings.height;
+  if (filter_active() || global.result_total <= global.frame_count || global.page_requested
+      || global.result_highlight + visible < global.frame_count) {
+    return;
+  }
+  if (write_to_remote(to_write, PAGE_REQUEST "%u\n", global.frame_count)) {
+    fprintf(stderr, "Failed to write.\n");
+    return;
+  }
+  global.page_requested = global.frame_count;
+}
+
+/* @brief Hands the selected action over before anything is torn down: it is
+ *        written unbuffered and standard out is closed, so `lighthouse | sh`
+ *        runs it right away, then the window is unmapped. With the exec
+ *        setting, lighthouse runs it itself instead (see exec_action), and
+ *        prints it if that fails.
+ *
+ * @param connection A connection to the Xorg server.
+ * @param window The window of lighthouse.
+ * @param action The action of the selected result.
+ * @return Void.
+ */
+static void hand_off_action(xcb_connection_t *connection, xcb_window_t window, const char *action) {
+  if (settings.exec_actions) {
+    if (!exec_action(action)) {
+      xcb_unmap_window(connection, window);
+      xcb_flush(connection);
+      return;
+    }
+    /* Not lost: it is printed as without exec=1. */
+    fprintf(stderr, "Printing the action instead.\n");
+  }
+
+  fflush(stdout);
+  size_t length = strlen(action);
+  size_t written = 0;
+  while (written < length) {
+    ssize_t ret = write(STDOUT_FILENO, action + written, length - written);
+    if (ret == -1 && errno == EINTR) {
+      continue;
+    } else if (ret <= 0) {
+      fprintf(stderr, "Couldn't write the action: %s\n", strerror(errno));
+      break;
+    }
+    written += ret;
+  }
+  /* The reader sees the end of its input, fd 1 stays valid for stray writes. */
+  int32_t null_fd = open("/dev/null", O_WRONLY);
+  if (null_fd != -1) {
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+  } else {
+    close(STDOUT_FILENO);
+  }
+
+  xcb_unmap_window(connection, window);
+  xcb_flush(connection);
+}
+
 /* @brief Processes an entered key by:
  *
  * 1) Adding the key to the query buffer (backspace will remove a character).
@@ -248,34 +335,44 @@ static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer
   debug("key: %u, modifier: %u\n", key, mod_key);
 
   uint32_t highlight = global.result_highlight;
+  uint32_t previous_highlight = global.result_highlight;
   uint32_t old_pos;
   if (global.result_count && key == 100 && mod_key == 3) {
     /* CTRL-D
      * GO down to the next title
      */
     next_title(&highlight);
-    draw_result_text(connection, window, cairo_context, cairo_surface, global.results);
+    draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
   } else if (global.result_count && key == 117 && mod_key == 3) {
     /* CTRL-U
      * GO up to the next title
      */
     previous_title(&highlight);
-    draw_result_text(connection, window, cairo_context, cairo_surface, global.results);
+    draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
+  } else if (key == 116 && mod_key == 3) {
+    /* CTRL-T
+     * Toggle the debug HUD (timings of the last frame).
+     */
+    global.show_hud = !global.show_hud;
+    redraw = 1;
+    if (global.result_count) {
+      draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
+    }
   } else {
   switch (key) {
     case 65293: /* Enter. */
       if (global.results && global.result_highlight < global.result_count) {
-        printf("%s", global.results[global.result_highlight].action);
+        hand_off_action(connection, window, result_string(global.result_base, global.results[global.result_highlight].action));
         goto cleanup;
       }
       break;
     case 65471: /* F2 */
       next_title(&highlight);
-      draw_result_text(connection, window, cairo_context, cairo_surface, global.results);
+      draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
       break;
     case 65472: /* F3 */
       previous_title(&highlight);
-      draw_result_text(connection, window, cairo_context, cairo_surface, global.results);
+      draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
       break;
     case 65361: /* Left. */
       if (*query_cursor_index > 0) {
@@ -295,7 +392,7 @@ static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer
       if (highlight) { /* Avoid segfault when highlight on the top. */
         old_pos = highlight;
         get_previous_non_title(&highlight);
-        if (!global.results[highlight].action) {
+        if (global.results[highlight].action == NO_OFFSET) {
             /* If it's a title it mean the get_previous_non_title function
             * found nothing and hit the top.
             */
@@ -304,7 +401,7 @@ static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer
                 global.result_offset--;
         }
         global.result_highlight = highlight;
-        draw_result_text(connection, window, cairo_context, cairo_surface, global.results);
+        draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
       }
       break;
     case 65364: /* Down. */
@@ -323,20 +420,20 @@ static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer
             global.result_offset++;
        }
        global.result_highlight = highlight;
-       draw_result_text(connection, window, cairo_context, cairo_surface, global.results);
+       draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
       }
       break;
     case 65289: /* Tab. */
       if (!global.result_count)
           break;
       get_next_line(&highlight);
-      draw_result_text(connection, window, cairo_context, cairo_surface, global.results);
+      draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
       break;
     case 65056: /* Shift Tab */
       if (!global.result_count)
           break;
       get_previous_line(&highlight);
-      draw_result_text(connection, window, cairo_context, cairo_surface, global.results);
+      draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
       break;
     case 65307: /* Escape. */
       goto cleanup;
@@ -366,13 +463,32 @@ static inline int32_t process_key_stroke(xcb_window_t window, char *query_buffer
 
   if (redraw) {
     draw_query_text(cairo_context, cairo_surface, query_buffer, *query_cursor_index);
+    uint64_t flush_begin = trace_begin();
     xcb_flush(connection);
+    trace_end(TRACE_FLUSH, flush_begin, 0);
   }
 
-  if (resend) {
+  if (resend && filter_query(query_buffer)) {
+    /* Filtered here, the cmd isn't asked. */
+    if (global.result_count) {
+      draw_result_text(connection, window, cairo_context, cairo_surface, global.result_base, global.results);
+    } else {
+      resize_window(connection, window, cairo_surface, settings.width, settings.height);
+    }
+  } else if (resend) {
     if (write_to_remote(to_write, "%s\n", query_buffer)) {
       fprintf(stderr, "Failed to write.\n");
+    } else {
+      stats_query_sent();
     }
+    PROBE2(query__send, query_buffer, *query_index);
+  } else {
+    request_next_page(to_write);
+  }
+
+  if (global.result_highlight != previous_highlight) {
+    global.highlight_time = trace_now();
+    wake_results();
   }
 
   pthread_mutex_unlock(&global.result_mutex);
@@ -436,8 +552,30 @@ static void set_setting(char *param, char *val) {
     sscanf(val, "%u", &settings.screen);
   } else if (!strcmp("backspace_exit", param)) {
     sscanf(val, "%d", &settings.backspace_exit);
+  } else if (!strcmp("exec", param)) {
+    sscanf(val, "%d", &settings.exec_actions);
   } else if (!strcmp("cmd", param)) {
     settings.cmd = val;
+  } else if (!strcmp("cmd_launch", param)) {
+    settings.cmd_launch = val;
+  } else if (!strcmp("cmd_nice", param)) {
+    sscanf(val, "%d", &settings.cmd_nice);
+  } else if (!strcmp("cmd_ionice", param)) {
+    settings.cmd_ionice = val;
+  } else if (!strcmp("cmd_cpu_limit", param)) {
+    sscanf(val, "%u", &settings.cmd_cpu_limit);
+  } else if (!strcmp("cmd_memory_limit", param)) {
+    sscanf(val, "%u", &settings.cmd_memory_limit);
+  } else if (!strcmp("cmd_cgroup", param)) {
+    settings.cmd_cgroup = val;
+  } else if (!strcmp("regex_prefix", param)) {
+    settings.regex_prefix = val;
+  } else if (!strcmp("fuzzy_prefix", param)) {
+    settings.fuzzy_prefix = val;
+  } else if (!strcmp("fuzzy_edits", param)) {
+    sscanf(val, "%u", &settings.fuzzy_edits);
+  } else if (!strcmp("boolean_prefix", param)) {
+    settings.boolean_prefix = val;
   } else if (!strcmp("query_fg", param)) {
       set_color_setting(val, &settings.query_fg);
   } else if (!strcmp("query_bg", param)) {
@@ -462,6 +600,18 @@ static void set_setting(char *param, char *val) {
     sscanf(val, "%u", &settings.line_gap);
   } else if (!strcmp("desc_font_size", param)) {
     sscanf(val, "%u", &settings.desc_font_size);
+  } else if (!strcmp("threads", param)) {
+    sscanf(val, "%u", &settings.threads);
+  } else if (!strcmp("desc_dwell", param)) {
+    sscanf(val, "%u", &settings.desc_dwell);
+  } else if (!strcmp("format", param)) {
+    if (!strcmp("jsonl", val)) {
+      settings.format = FORMAT_JSONL;
+    } else if (!strcmp("braces", val)) {
+      settings.format = FORMAT_BRACES;
+    } else {
+      fprintf(stderr, "Unknown format %s.\n", val);
+    }
   }
 }
 
@@ -591,6 +741,7 @@ static int initialize_settings(char *config_file) {
   settings.backspace_exit = 1;
   settings.dock_mode = 1;
   settings.desc_size = 300;
+  settings.desc_dwell = 150;
   settings.auto_center = 1;
   settings.line_gap = 20;
   settings.desc_font_size = FONT_SIZE;
@@ -603,16 +754,35 @@ static int initialize_settings(char *config_file) {
     config_file = expanded_file.we_wordv[0];
   }
 
-  size_t ret = 0;
   int32_t fd = open(config_file, O_RDONLY);
   if (fd == -1) {
     fprintf(stderr, "Couldn't open config file %s: %s\n", config_file, strerror(errno));
     return 1;
-  } else {
-    ret = read(fd, global.config_buf, sizeof(global.config_buf));
   }
+  struct stat config_stat;
+  if (fstat(fd, &config_stat)) {
+    fprintf(stderr, "Couldn't stat config file %s: %s\n", config_file, strerror(errno));
+    close(fd);
+    return 1;
+  }
+  size_t ret = config_stat.st_size;
+  if (ret) {
+    /* Private and writable: the parsing below writes a null terminator on
+     * every line, so every page with a line is copied on write, the file is
+     * never changed. The settings point into it until exit, the results
+     * thread may use them to the end, so it is never unmapped. */
+    global.config_buf = mmap(NULL, ret, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (global.config_buf == MAP_FAILED) {
+      fprintf(stderr, "Couldn't map config file %s: %s\n", config_file, strerror(errno));
+      global.config_buf = NULL;
+      close(fd);
+      return 1;
+    }
+  }
+  close(fd);
 
-  int32_t i, mode;
+  size_t i;
+  int32_t mode;
   mode = 1; /* 0 looking for param. 1 looking for value. 2 skipping chars */
   char *curr_param = global.config_buf;
   char *curr_val = NULL;
@@ -643,11 +813,50 @@ static int initialize_settings(char *config_file) {
 /* @brief A function called at the end of execution to clean up
  *        the spawned child process.
  *
+ * The action was already handed over (see hand_off_action), and lighthouse
+ * exits right away: the cmd gets SIGTERM, and a helper process kills it if it
+ * is still running KILL_TIMEOUT_MS later.
+ *
  * @return Void.
  */
 void kill_zombie(void) {
-  kill(global.child_pid, SIGTERM);
-  while(wait(NULL) == -1);
+  if (global.child_pid <= 0) {
+    /* No child when replaying a session, and backends on a socket are left
+     * running for the next time. */
+    return;
+  }
+  pid_t pid = global.child_pid;
+  kill(pid, SIGTERM);
+  if (waitpid(pid, NULL, WNOHANG) == pid) {
+    return;
+  }
+
+  long max_fd = sysconf(_SC_OPEN_MAX);
+  pid_t reaper = fork();
+  if (reaper == -1) {
+    debug("Could not fork to reap the cmd: %s\n", strerror(errno));
+    return;
+  }
+  if (reaper) {
+    return;
+  }
+  /* The cmd is reparented once lighthouse is gone, so it is polled rather
+   * than waited for. Nothing of lighthouse is kept open, the cmd and the
+   * reader of the action see the end of their pipes. */
+  int32_t fd;
+  for (fd = 0; fd < (max_fd > 0 ? max_fd : 1024); fd++) {
+    close(fd);
+  }
+  struct timespec delay = { 0, 5 * 1000 * 1000 };
+  uint32_t waited;
+  for (waited = 0; waited < KILL_TIMEOUT_MS; waited += 5) {
+    if (kill(pid, 0) == -1 && errno == ESRCH) {
+      _exit(0);
+    }
+    nanosleep(&delay, NULL);
+  }
+  kill(pid, SIGKILL);
+  _exit(0);
 }
 
 
@@ -667,17 +876,40 @@ int main(int argc, char **argv) {
     return 1;
   }
   sprintf(config_file, "%s%s", config_file_dir, CONFIG_FILE);
+  char *record_file = NULL;
+  char *replay_file = NULL;
+  int32_t replay_fast = 0;
+  char *trace_file = NULL;
   int c;
-  while ((c = getopt(argc, argv, "c:")) != -1) {
+  while ((c = getopt(argc, argv, "c:r:p:Ft:")) != -1) {
     switch (c) {
       case 'c':
         config_file = strdup(optarg);
         break;
+      case 'r':
+        record_file = optarg;
+        break;
+      case 'p':
+        replay_file = optarg;
+        break;
+      case 'F':
+        replay_fast = 1;
+        break;
+      case 't':
+        trace_file = optarg;
+        break;
       default:
         break;
     }
   }
 
+  if (record_file) {
+    if (session_record_open(record_file)) {
+      return 1;
+    }
+    atexit(session_record_close);
+  }
+
   if (initialize_settings(config_file)) {
     free(config_file);
     return 1;
@@ -704,21 +936,53 @@ int main(int argc, char **argv) {
 
   /* Set up the remote process. */
   int32_t to_child_fd, from_child_fd;
+  int32_t replay_fd = -1;
 
   char *exec_file = settings.cmd;
 
-  if (spawn_piped_process(exec_file, &to_child_fd, &from_child_fd, (char **)cmdargs)) {
+  if (replay_file) {
+    /* The recorded frames replace the cmd, the queries are discarded. */
+    int32_t replay_pipe[2];
+    if (pipe(replay_pipe)) {
+      fprintf(stderr, "Couldn't create replay pipe: %s\n", strerror(errno));
+      return 1;
+    }
+    from_child_fd = replay_pipe[0];
+    replay_fd = replay_pipe[1];
+    to_child_fd = open("/dev/null", O_WRONLY);
+  } else if (!strncmp(exec_file, UNIX_PREFIX, strlen(UNIX_PREFIX))) {
+    if (connect_backend(exec_file + strlen(UNIX_PREFIX), settings.cmd_launch, &to_child_fd, &from_child_fd, (char **)cmdargs)) {
+      exit_code = 1;
+      return exit_code;
+    }
+  } else if (spawn_piped_process(exec_file, &to_child_fd, &from_child_fd, (char **)cmdargs)) {
     fprintf(stderr, "Failed to spawn piped process.\n");
     exit_code = 1;
     return exit_code;
   }
 
+  /* After the spawn, the cmd mustn't inherit the blocked SIGUSR2. */
+  if (trace_file) {
+    if (trace_start(trace_file)) {
+      return 1;
+    }
+    trace_thread_name("main");
+  }
+  if (stats_start(from_child_fd, to_child_fd)) {
+    return 1;
+  }
+  if (scheduler_start(settings.threads)) {
+    return 1;
+  }
+  atexit(scheduler_stop);
+
   /* Don't free #0, it is filled in by spawn_piped_process() and isn't memory that we own */
   for (i=1; i < nargs - 1 ; i++)
     free(cmdargs[i]);
 
   /* The main way to communicate with our remote process. */
   FILE *to_child = fdopen(to_child_fd, "w");
+  global.to_child = to_child;
 
   /* Connect to the X server. */
   xcb_connection_t *connection = xcb_connect(NULL, NULL);
@@ -889,6 +1153,11 @@ int main(int argc, char **argv) {
 
   xcb_map_window(connection, window);
 
+  if (replay_file && session_replay_start(replay_file, replay_fast, replay_fd, connection, window)) {
+    exit_code = 1;
+    goto cleanup;
+  }
+
   /* Query string. */
   char query_string[MAX_QUERY];
   memset(query_string, 0, sizeof(query_string));
@@ -916,15 +1185,23 @@ int main(int argc, char **argv) {
   xcb_configure_window(connection, window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
 
   xcb_generic_event_t *event;
-  while ((event = xcb_wait_for_event(connection))) {
+  while (1) {
+    uint64_t wait_begin = trace_begin();
+    event = xcb_wait_for_event(connection);
+    trace_end(TRACE_EVENT_WAIT, wait_begin, 0);
+    if (!event) {
+      break;
+    }
     switch (event->response_type & ~0x80) {
       case XCB_EXPOSE: {
         /* Get the input focus. */
         xcb_void_cookie_t focus_cookie = xcb_set_input_focus_checked(connection, XCB_INPUT_FOCUS_POINTER_ROOT, window, XCB_CURRENT_TIME);
         check_xcb_cookie(focus_cookie, connection, "Failed to grab focus.");
 
-        /* Redraw. */
+        /* Redraw, the results thread may be replacing the results. */
+        pthread_mutex_lock(&global.result_mutex);
         redraw_all(connection, window, cairo_context, cairo_surface, query_string, query_cursor_index);
+        pthread_mutex_unlock(&global.result_mutex);
         break;
       }
       case XCB_KEY_PRESS: {
@@ -932,8 +1209,11 @@ int main(int argc, char **argv) {
       }
       case XCB_KEY_RELEASE: {
         xcb_key_release_event_t *k = (xcb_key_release_event_t *)event;
+        session_record_key(k->detail, k->state);
         xcb_keysym_t key = xcb_key_press_lookup_keysym(keysyms, k, k->state & ~XCB_MOD_MASK_2 & ~XCB_MOD_MASK_CONTROL);
+        uint64_t key_begin = trace_begin();
         int32_t ret = process_key_stroke(window, query_string, &query_index, &query_cursor_index, key, k->state, connection, cairo_context, cairo_surface, to_child);
+        trace_end(TRACE_KEY, key_begin, key);
         if (ret <= 0) {
           exit_code = ret;
           goto cleanup;
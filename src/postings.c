@@ -0,0 +1,407 @@
+/** @file postings.c
+ *
+ *  @brief This file contains the inverted index of the boolean filter (see
+ *         boolean_prefix): the words of the results, sorted, each with the
+ *         sorted list of the results it is in.
+ *
+ *  Queries are evaluated on the posting lists only, the texts of the
+ *  results aren't read again: intersections start from the shortest list
+ *  and gallop in the others, exclusions gallop too.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "postings.h"
+
+/* @brief A word of the vocabulary, and where its posting list is. */
+typedef struct {
+  const char *word;
+  uint32_t length;
+  uint32_t begin;
+  uint32_t count;
+} word_t;
+
+/* @brief A word found in a result, while indexing. */
+typedef struct {
+  const char *word;
+  uint32_t length;
+  uint32_t result;
+} occurrence_t;
+
+/* @brief The results matched by a clause of a query: a posting list of the
+ *        index, or the union of several (then owned). */
+typedef struct {
+  const uint32_t *list;
+  uint32_t count;
+  uint32_t *owned;
+  int32_t negated;
+} clause_t;
+
+struct postings_s {
+  char *words;        /* The words, lower case, one after the other. */
+  word_t *vocabulary; /* Sorted. */
+  uint32_t word_count;
+  uint32_t *lists;    /* The posting lists, one after the other. */
+  uint32_t *all;      /* The results indexed. */
+  uint32_t all_count;
+};
+
+static inline int32_t word_byte(unsigned char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+static inline char lower(char c) {
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static int32_t compare_words(const char *a, uint32_t a_length, const char *b, uint32_t b_length) {
+  int32_t c = memcmp(a, b, a_length < b_length ? a_length : b_length);
+  if (c) {
+    return c;
+  }
+  return a_length < b_length ? -1 : a_length > b_length;
+}
+
+static int compare_occurrences(const void *a, const void *b) {
+  const occurrence_t *x = a;
+  const occurrence_t *y = b;
+  int32_t c = compare_words(x->word, x->length, y->word, y->length);
+  if (c) {
+    return c;
+  }
+  return x->result < y->result ? -1 : x->result > y->result;
+}
+
+static int compare_indices(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* @brief Walks the words of a text.
+ *
+ * @param text The text, moved past the word.
+ * @param length Set to the length of the word.
+ * @return The word, or NULL at the end of the text.
+ */
+static const char *next_word(const char **text, uint32_t *length) {
+  const char *c = *text;
+  while (*c && !word_byte(*c)) {
+    c++;
+  }
+  if (!*c) {
+    *text = c;
+    return NULL;
+  }
+  const char *word = c;
+  while (word_byte(*c)) {
+    c++;
+  }
+  *length = c - word;
+  *text = c;
+  return word;
+}
+
+postings_t *postings_build(char *base, const result_t *results, uint32_t count) {
+  postings_t *postings = calloc(1, sizeof(postings_t));
+  if (!postings) {
+    return NULL;
+  }
+
+  /* Sizes first, everything is then allocated once. */
+  size_t bytes = 0;
+  uint32_t occurrence_count = 0;
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    if (results[i].action == NO_OFFSET) {
+      continue;
+    }
+    postings->all_count++;
+    const char *text = result_string(base, results[i].text);
+    uint32_t length;
+    while (next_word(&text, &length)) {
+      bytes += length;
+      occurrence_count++;
+    }
+  }
+
+  occurrence_t *occurrences = malloc((occurrence_count + 1) * sizeof(occurrence_t));
+  postings->words = malloc(bytes + 1);
+  postings->vocabulary = malloc((occurrence_count + 1) * sizeof(word_t));
+  postings->lists = malloc((occurrence_count + 1) * sizeof(uint32_t));
+  postings->all = malloc((postings->all_count + 1) * sizeof(uint32_t));
+  if (!occurrences || !postings->words || !postings->vocabulary || !postings->lists || !postings->all) {
+    free(occurrences);
+    postings_free(postings);
+    return NULL;
+  }
+
+  char *out = postings->words;
+  uint32_t o = 0;
+  uint32_t a = 0;
+  for (i = 0; i < count; i++) {
+    if (results[i].action == NO_OFFSET) {
+      continue;
+    }
+    postings->all[a++] = i;
+    const char *text = result_string(base, results[i].text);
+    const char *word;
+    uint32_t length;
+    while ((word = next_word(&text, &length))) {
+      uint32_t j;
+      for (j = 0; j < length; j++) {
+        out[j] = lower(word[j]);
+      }
+      occurrences[o++] = (occurrence_t){ out, length, i };
+      out += length;
+    }
+  }
+
+  qsort(occurrences, occurrence_count, sizeof(occurrence_t), compare_occurrences);
+
+  /* Equal words are now together, their results in order. */
+  uint32_t list_length = 0;
+  word_t *word = NULL;
+  for (o = 0; o < occurrence_count; o++) {
+    occurrence_t *occurrence = &occurrences[o];
+    if (!word || compare_words(word->word, word->length, occurrence->word, occurrence->length)) {
+      word = &postings->vocabulary[postings->word_count++];
+      *word = (word_t){ occurrence->word, occurrence->length, list_length, 0 };
+    } else if (postings->lists[list_length - 1] == occurrence->result) {
+      continue; /* Twice in the same result. */
+    }
+    postings->lists[list_length++] = occurrence->result;
+    word->count++;
+  }
+  free(occurrences);
+  return postings;
+}
+
+void postings_free(postings_t *postings) {
+  if (!postings) {
+    return;
+  }
+  free(postings->words);
+  free(postings->vocabulary);
+  free(postings->lists);
+  free(postings->all);
+  free(postings);
+}
+
+/* @brief Finds the words a prefix starts, they follow each other in the
+ *        vocabulary.
+ *
+ * @param postings The index.
+ * @param prefix The prefix, lower case.
+ * @param length The length of the prefix.
+ * @param end Set past the last word.
+ * @return The first word.
+ */
+static uint32_t find_words(const postings_t *postings, const char *prefix, uint32_t length, uint32_t *end) {
+  uint32_t low = 0;
+  uint32_t high = postings->word_count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    const word_t *word = &postings->vocabulary[middle];
+    if (compare_words(word->word, word->length, prefix, length) < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  uint32_t last = low;
+  while (last < postings->word_count && postings->vocabulary[last].length >= length
+         && !memcmp(postings->vocabulary[last].word, prefix, length)) {
+    last++;
+  }
+  *end = last;
+  return low;
+}
+
+/* @brief Gathers the results of a clause: the union of the posting lists of
+ *        the words its alternatives start.
+ *
+ * @param postings The index.
+ * @param text The alternatives, lower case, separated by |.
+ * @param length The length of text.
+ * @param clause Set to the results.
+ * @return 0 on success and 1 if out of memory.
+ */
+static int32_t gather_clause(const postings_t *postings, const char *text, uint32_t length, clause_t *clause) {
+  uint32_t word_count = 0;
+  uint32_t total = 0;
+  uint32_t pass;
+  for (pass = 0; pass < 2; pass++) {
+    const char *alternative = text;
+    while (alternative < text + length) {
+      const char *bar = memchr(alternative, '|', text + length - alternative);
+      uint32_t alternative_length = (bar ? bar : text + length) - alternative;
+      uint32_t w = 0;
+      uint32_t end = 0;
+      if (alternative_length) {
+        w = find_words(postings, alternative, alternative_length, &end);
+      }
+      for (; w < end; w++) {
+        const word_t *word = &postings->vocabulary[w];
+        if (pass == 0) {
+          word_count++;
+          total += word->count;
+          clause->list = postings->lists + word->begin;
+          clause->count = word->count;
+        } else {
+          memcpy(clause->owned + clause->count, postings->lists + word->begin, word->count * sizeof(uint32_t));
+          clause->count += word->count;
+        }
+      }
+      alternative += alternative_length + 1;
+    }
+    if (pass == 0) {
+      if (word_count <= 1) {
+        /* A single list is used as it is. */
+        if (!word_count) {
+          clause->list = postings->lists;
+          clause->count = 0;
+        }
+        return 0;
+      }
+      clause->owned = malloc(total * sizeof(uint32_t));
+      if (!clause->owned) {
+        return 1;
+      }
+      clause->count = 0;
+    }
+  }
+
+  qsort(clause->owned, clause->count, sizeof(uint32_t), compare_indices);
+  uint32_t unique = 0;
+  uint32_t i;
+  for (i = 0; i < clause->count; i++) {
+    if (!unique || clause->owned[unique - 1] != clause->owned[i]) {
+      clause->owned[unique++] = clause->owned[i];
+    }
+  }
+  clause->list = clause->owned;
+  clause->count = unique;
+  return 0;
+}
+
+/* @brief Finds the first entry of a sorted list not below a value, from a
+ *        position on: steps of 1, 2, 4... then a binary search in the last
+ *        step, so far values cost a logarithm of the distance.
+ */
+static uint32_t gallop(const uint32_t *list, uint32_t count, uint32_t from, uint32_t value) {
+  uint32_t low = from;
+  uint32_t high = from;
+  uint32_t step = 1;
+  while (high < count && list[high] < value) {
+    low = high + 1;
+    high = count - high > step ? high + step : count;
+    step *= 2;
+  }
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (list[middle] < value) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/* @brief Keeps the entries of a sorted list that are (or, if negated, are
+ *        not) in another.
+ *
+ * @return The number of entries kept, at the start of the list.
+ */
+static uint32_t filter_list(uint32_t *list, uint32_t count, const clause_t *clause) {
+  uint32_t kept = 0;
+  uint32_t position = 0;
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    position = gallop(clause->list, clause->count, position, list[i]);
+    int32_t found = position < clause->count && clause->list[position] == list[i];
+    if (found != clause->negated) {
+      list[kept++] = list[i];
+    } else if (position == clause->count && !clause->negated) {
+      break;
+    }
+  }
+  return kept;
+}
+
+uint32_t postings_query(postings_t *postings, const char *query, uint32_t *matches) {
+  size_t query_length = strlen(query);
+  char *text = malloc(query_length + 1);
+  if (!text) {
+    return 0;
+  }
+  size_t i;
+  for (i = 0; i <= query_length; i++) {
+    text[i] = lower(query[i]);
+  }
+
+  /* A clause is a run of words and |, maybe after a !. */
+  clause_t clauses[POSTINGS_MAX_CLAUSES];
+  uint32_t clause_count = 0;
+  const char *c = text;
+  while (*c && clause_count < POSTINGS_MAX_CLAUSES) {
+    int32_t negated = *c == '!';
+    if (negated) {
+      c++;
+    }
+    const char *begin = c;
+    int32_t words = 0;
+    while (word_byte(*c) || *c == '|') {
+      words |= *c != '|';
+      c++;
+    }
+    if (!words) {
+      /* Nothing, or stray bars: ignored. */
+      if (c == begin && !negated) {
+        c++;
+      }
+      continue;
+    }
+    clause_t *clause = &clauses[clause_count];
+    *clause = (clause_t){ NULL, 0, NULL, negated };
+    if (gather_clause(postings, begin, c - begin, clause)) {
+      break;
+    }
+    clause_count++;
+  }
+  free(text);
+
+  /* The shortest list of results first, every step can only shrink it. */
+  uint32_t j;
+  for (j = 1; j < clause_count; j++) {
+    clause_t clause = clauses[j];
+    uint32_t k = j;
+    while (k > 0 && (clauses[k - 1].negated > clause.negated
+                     || (clauses[k - 1].negated == clause.negated && clauses[k - 1].count > clause.count))) {
+      clauses[k] = clauses[k - 1];
+      k--;
+    }
+    clauses[k] = clause;
+  }
+
+  uint32_t count;
+  j = 0;
+  if (clause_count && !clauses[0].negated) {
+    count = clauses[0].count;
+    memcpy(matches, clauses[0].list, count * sizeof(uint32_t));
+    j = 1;
+  } else {
+    count = postings->all_count;
+    memcpy(matches, postings->all, count * sizeof(uint32_t));
+  }
+  for (; j < clause_count && count; j++) {
+    count = filter_list(matches, count, &clauses[j]);
+  }
+
+  for (j = 0; j < clause_count; j++) {
+    free(clauses[j].owned);
+  }
+  return count;
+}
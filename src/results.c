@@ -11,6 +11,7 @@
 
 #include "globals.h"
 #include "results.h"
+#include "stats.h"
 
 /* @brief Get character between % (function called from parse_result_line).
  * @param c A reference to the pointer to the current position.
@@ -99,9 +100,12 @@ static void get_characters_cairo(cairo_t *cr, char **c, char **data, uint32_t *d
 }
 #endif
 
-static inline void set_new_size(modifier_type_t **modifiers_array, uint32_t size) {
-    modifier_type_t *tmp = realloc(*modifiers_array, size * sizeof(modifier_type_t));
-    *modifiers_array = tmp;
+/* @brief Opens a modifier, it stays until the matching '%'. */
+static inline void push_modifier(modifier_stack_t *modifiers, modifier_type_t modifier) {
+    if (modifiers->length < MAX_MODIFIERS) {
+        modifiers->modifiers[modifiers->length] = modifier;
+    }
+    modifiers->length++;
 }
 
 /* @brief Parses the text pointed to by *c and moves *c to
@@ -110,20 +114,20 @@ static inline void set_new_size(modifier_type_t **modifiers_array, uint32_t size
  * @param *cr a cairo context (used to know the space used by the font).
  * @param[in/out] c A reference to the pointer to the current section
  * @param line_length length in pixel of the line.
+ * @param modifiers The modifiers opened so far in the text, updated. The
+ *              returned draw_t points into it.
  * @return A populated draw_t type.
  */
 #ifndef NO_PANGO
-draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_type_t **modifiers_array, PangoFontDescription *font_description) {
+draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_stack_t *modifiers, PangoFontDescription *font_description) {
 #else
-draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_type_t **modifiers_array) {
+draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_stack_t *modifiers) {
 #endif
   if (!c || !*c) {
     fprintf(stderr, "Invalid parse state");
     return (draw_t){ DRAW_TEXT, NULL }; /* This will invoke a segfault most likely. */
   }
 
-  static uint32_t modifiers_array_length = 0;
-
   char *data = NULL;
   draw_type_t type = DRAW_TEXT;
   uint32_t data_length = 0;
@@ -146,16 +150,14 @@ draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_t
         while (**c != '%') {
             *c += 1;
         }
-        modifiers_array_length++;
-        set_new_size(modifiers_array, modifiers_array_length);
-        (*modifiers_array)[modifiers_array_length - 1] = NONE;
+        push_modifier(modifiers, NONE);
         /* DRAW_IMAGE type is special, it need to be followed by the image filename, so
          * the %I..% are used to specify it.
          * If we don't use a trivial modifier, in this case:
          *      %C... %I...%...%
          *                 ^
          *                 |
-         *                 +--- At this point the modifiers_array_length
+         *                 +--- At this point the modifiers length
          *                      is decremented in the "default" case
          *                      so the previous argument is erased and lost.
          *  The text won't be centered anymore after the %I...%
@@ -164,7 +166,7 @@ draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_t
       case 'N':
         /* In this case the type is "simple" (%N) so it don't need the
          * a trivial modifier because it will never hit another '%'
-         * that cause a "modfifiers_array_length" decrementation.
+         * that cause a modifiers length decrementation.
          */
         type = NEW_LINE;
         *c += 2;
@@ -185,9 +187,7 @@ draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_t
 #else
         get_characters_cairo(cr, c, &data, &data_length, line_length);
 #endif
-        modifiers_array_length++;
-        set_new_size(modifiers_array, modifiers_array_length);
-        (*modifiers_array)[modifiers_array_length - 1] = CENTER;
+        push_modifier(modifiers, CENTER);
         break;
       case 'B':
         /* Work with the DRAW_TEXT type */
@@ -198,9 +198,7 @@ draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_t
         get_characters_cairo(cr, c, &data, &data_length, line_length);
 #endif
 
-        modifiers_array_length++;
-        set_new_size(modifiers_array, modifiers_array_length);
-        (*modifiers_array)[modifiers_array_length - 1] = BOLD;
+        push_modifier(modifiers, BOLD);
         break;
       case '\\':
         /* If '\\' is used, it mean the user used a char like (C, B, I, ...)
@@ -225,17 +223,16 @@ draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_t
         get_characters_cairo(cr, c, &data, &data_length, line_length);
 #endif
 
-        if (modifiers_array_length)
-            modifiers_array_length--;
+        if (modifiers->length)
+            modifiers->length--;
         else
             debug("Error in the result text: '%%' wrongly placed.");
-        set_new_size(modifiers_array, modifiers_array_length);
         break;
     }
   } else {
     /* When we are in a case like this:
      * %C ... String to long to be drawn in one line ... %
-     * We just don't touch the modifiers_array so it still have the old
+     * We just don't touch the modifiers so it still have the old
      * modifier used previously in memory.
      * Those will be erased at the '%' (default case normally).
      */
@@ -256,12 +253,176 @@ draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_t
 #endif
 
   }
-  return (draw_t){ type, *modifiers_array, modifiers_array_length, data, data_length };
+  uint32_t length = modifiers->length < MAX_MODIFIERS ? modifiers->length : MAX_MODIFIERS;
+  return (draw_t){ type, modifiers->modifiers, length, data, data_length };
+}
+
+/* @brief Parses the page header that may start a frame: %P<total>% for the
+ *        first page of the results, %P<total>@<offset>% for the next ones.
+ *
+ * @param text The frame.
+ * @param total Set to the total number of results the cmd has.
+ * @param offset Set to the index of the first result of the frame.
+ * @return The length of the header, 0 if there is none.
+ */
+uint32_t parse_page_header(const char *text, uint32_t *total, uint32_t *offset) {
+  if (text[0] != '%' || text[1] != 'P' || text[2] < '0' || text[2] > '9') {
+    return 0;
+  }
+  char *end;
+  *total = strtoul(text + 2, &end, 10);
+  *offset = 0;
+  if (*end == '@' && end[1] >= '0' && end[1] <= '9') {
+    *offset = strtoul(end + 1, &end, 10);
+  }
+  if (*end != '%') {
+    return 0;
+  }
+  return end + 1 - text;
+}
+
+/* @brief Parses a description token, %D<token>%.
+ *
+ * @param text The description (or a frame answering a description request).
+ * @param token Set to the start of the token.
+ * @param length Set to the length of the token.
+ * @return The length of the %D<token>% prefix, 0 if text doesn't start with one.
+ */
+uint32_t parse_desc_token(const char *text, const char **token, uint32_t *length) {
+  if (text[0] != '%' || text[1] != 'D') {
+    return 0;
+  }
+  const char *end = strchr(text + 2, '%');
+  if (!end || end == text + 2) {
+    return 0;
+  }
+  *token = text + 2;
+  *length = end - *token;
+  return end + 1 - text;
+}
+
+/* @brief The last descriptions fetched, by token, replaced round robin. */
+#define DESC_CACHE_SIZE   8
+static struct {
+  char *token; /* The description follows the token in the same allocation. */
+  uint32_t length;
+} desc_cache[DESC_CACHE_SIZE];
+static uint32_t desc_cache_next = 0;
+
+const char *desc_cache_get(const char *token, uint32_t length) {
+  uint32_t i;
+  for (i = 0; i < DESC_CACHE_SIZE; i++) {
+    if (desc_cache[i].token && desc_cache[i].length == length
+        && !memcmp(desc_cache[i].token, token, length)) {
+      stats_add(STAT_DESC_CACHE_HITS, 1);
+      return desc_cache[i].token + length + 1;
+    }
+  }
+  stats_add(STAT_DESC_CACHE_MISSES, 1);
+  return NULL;
+}
+
+void desc_cache_put(const char *token, uint32_t length, const char *desc) {
+  size_t desc_length = strlen(desc);
+  char *entry = malloc(length + desc_length + 2);
+  if (!entry) {
+    return;
+  }
+  memcpy(entry, token, length);
+  entry[length] = '\0';
+  memcpy(entry + length + 1, desc, desc_length + 1);
+  free(desc_cache[desc_cache_next].token);
+  desc_cache[desc_cache_next].token = entry;
+  desc_cache[desc_cache_next].length = length;
+  desc_cache_next = (desc_cache_next + 1) % DESC_CACHE_SIZE;
+}
+
+/* @brief Hash of a string (FNV-1a). */
+static inline uint32_t hash_string(const char *s, uint32_t length) {
+  uint32_t hash = 2166136261u;
+  uint32_t i;
+  for (i = 0; i < length; i++) {
+    hash ^= (uint8_t)s[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* @brief A slot of the table of intern_results. */
+typedef struct {
+  uint32_t offset; /* Of the kept copy, plus one: 0 is an empty slot. */
+  uint32_t length;
+} interned_t;
+
+size_t intern_results(char *text, size_t length, result_t *results, uint32_t count) {
+  if (!count) {
+    return length;
+  }
+  /* Open addressing, at most half full. Without it the strings are still
+   * compacted and measured, just not shared. */
+  uint32_t size = 16;
+  while (size / 4 < count) {
+    size *= 2;
+  }
+  interned_t *table = calloc(size, sizeof(interned_t));
+
+  /* The strings are taken in the order they are in the frame, so a copy
+   * only ever moves one back and never overwrites one not yet taken. */
+  size_t used = 0;
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    result_t *r = &results[i];
+    uint32_t *offsets[] = { &r->text, &r->action, &r->desc };
+    uint32_t *lengths[] = { &r->text_length, &r->action_length, &r->desc_length };
+    /* In JSON Lines the keys of a result come in any order. */
+    uint32_t order[] = { 0, 1, 2 };
+    uint32_t j, k;
+    for (j = 1; j < 3; j++) {
+      for (k = j; k > 0 && *offsets[order[k - 1]] > *offsets[order[k]]; k--) {
+        uint32_t swap = order[k];
+        order[k] = order[k - 1];
+        order[k - 1] = swap;
+      }
+    }
+    for (j = 0; j < 3; j++) {
+      uint32_t field = order[j];
+      uint32_t offset = *offsets[field];
+      if (offset == NO_OFFSET) {
+        *lengths[field] = 0;
+        continue;
+      }
+      uint32_t string_length = strlen(text + offset);
+      *lengths[field] = string_length;
+      interned_t *slot = NULL;
+      if (field && table) {
+        uint32_t h = hash_string(text + offset, string_length) & (size - 1);
+        while (table[h].offset && (table[h].length != string_length
+                                   || memcmp(text + table[h].offset - 1, text + offset, string_length))) {
+          h = (h + 1) & (size - 1);
+        }
+        if (table[h].offset) {
+          *offsets[field] = table[h].offset - 1;
+          continue;
+        }
+        slot = &table[h];
+      }
+      memmove(text + used, text + offset, string_length + 1);
+      *offsets[field] = used;
+      if (slot) {
+        *slot = (interned_t){ used + 1, string_length };
+      }
+      used += string_length + 1;
+    }
+  }
+  free(table);
+  return used - 1;
 }
 
 /* @brief Parses text to populate a results structure.
  *
  * note: An allocation is done in this function, so results should be freed.
+ *       The results point into the text (see result_string), keep it as long
+ *       as they are used.
  *
  * @param text The text to be parsed.
  * @param length The length of the text passed in (in bytes).
@@ -269,8 +430,13 @@ draw_t parse_result_line(cairo_t *cr, char **c, uint32_t line_length, modifier_t
  * @return Number of results parsed.
  */
 uint32_t parse_result_text(char *text, size_t length, result_t **results) {
-  int32_t index, mode;
+  uint32_t index;
+  int32_t mode;
   mode = 0; /* 0 -> closed, 1 -> opened no command (action), 2 -> opened, command (desc)*/
+  if (length >= NO_OFFSET) {
+    fprintf(stderr, "Frame too large: %zu bytes.\n", length);
+    return 0;
+  }
   result_t *ret = calloc(1, sizeof(result_t));
   uint32_t count = 0;
   for (index = 0; text[index] != 0 && index < length; index++) {
@@ -290,47 +456,45 @@ uint32_t parse_result_text(char *text, size_t length, result_t **results) {
     /* Opening brace. */
     else if (text[index] == '{') {
       if (mode != 0) {
-        fprintf(stderr, "Syntax error, found { at index %d.\n %s\n", index, text);
+        fprintf(stderr, "Syntax error, found { at index %u.\n %s\n", index, text);
         free(ret);
         return 0;
       }
       count++;
       ret = realloc(ret, count * sizeof(ret[0]));
-      if (index + 1 < length) {
-        ret[count - 1].text = &(text[index+1]);
-      }
+      ret[count - 1] = (result_t){ index + 1, NO_OFFSET, NO_OFFSET, 0, 0, 0 };
       mode++;
     }
     /* Split brace. */
     else if (text[index] == '|') {
       text[index] = 0;
       if (mode == 0) {
-        fprintf(stderr, "Syntax error, found | at index %d.\n %s\n", index, text);
+        fprintf(stderr, "Syntax error, found | at index %u.\n %s\n", index, text);
         free(ret);
         return 0;
       } else if ((index + 1 < length) && (mode == 1)){
-        ret[count - 1].action = &(text[index+1]);
+        ret[count - 1].action = index + 1;
         /* Can be a description or an action */
       } else if ((index + 1 < length) && (mode == 2)){
-        ret[count - 1].desc = &(text[index+1]);
+        ret[count - 1].desc = index + 1;
       }
       mode++;
     }
     /* Closing brace. */
     else if (text[index] == '}') {
       if (mode == 0) {
-        fprintf(stderr, "Syntax error, found } at index %d.\n %s\n", index, text);
+        fprintf(stderr, "Syntax error, found } at index %u.\n %s\n", index, text);
         free(ret);
         return 0;
       }
       if (mode == 1) {
         /* if no action */
-        ret[count - 1].action = NULL;
-        ret[count - 1].desc = NULL;
+        ret[count - 1].action = NO_OFFSET;
+        ret[count - 1].desc = NO_OFFSET;
       }
       if (mode == 2) {
         /* if no description */
-        ret[count - 1].desc = NULL;
+        ret[count - 1].desc = NO_OFFSET;
       }
       text[index] = 0;
       mode = 0;
@@ -339,4 +503,3 @@ uint32_t parse_result_text(char *text, size_t length, result_t **results) {
   *results = ret;
   return count;
 }
-
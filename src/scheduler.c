@@ -0,0 +1,313 @@
+/** @file scheduler.c
+ *
+ *  @brief This file contains the work-stealing scheduler the background work
+ *         (image decodes, layout, matching, indexing...) is submitted to.
+ *
+ *  Each worker owns one deque per priority. The owner pushes and pops at the
+ *  bottom, thieves take from the top. A deque is guarded by its own mutex,
+ *  held for a few instructions only; idle workers sleep on a condition.
+ *  The workers are only started by the first submission.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "scheduler.h"
+#include "trace.h"
+
+/* @brief Upper bound on the number of workers. */
+#define MAX_WORKERS       64
+
+/* @brief Initial capacity of a deque, it doubles when full. */
+#define DEQUE_MIN         64
+
+typedef struct {
+  sched_fn_t fn;
+  void *arg;
+  sched_token_t *token;
+} sched_task_t;
+
+/* @brief A ring of tasks, top is the oldest. */
+typedef struct {
+  pthread_mutex_t mutex;
+  sched_task_t *tasks;
+  uint32_t capacity;
+  uint32_t top;
+  uint32_t size;
+} sched_deque_t;
+
+typedef struct {
+  pthread_t thread;
+  uint32_t index;
+  sched_deque_t deques[SCHED_PRIORITIES];
+} sched_worker_t;
+
+static struct {
+  sched_worker_t *workers;
+  uint32_t requested; /* Workers to start on the first submission. */
+  int32_t enabled;
+  uint32_t count;
+  uint32_t started;
+  uint32_t next; /* Round robin for submissions from other threads. */
+  int32_t running;
+  uint32_t queued;
+  pthread_mutex_t mutex;
+  pthread_cond_t work; /* Signaled when a task is queued. */
+  pthread_cond_t done; /* Broadcast when a group is done. */
+} scheduler = { NULL, 0, 0, 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+
+static __thread sched_worker_t *current_worker = NULL;
+
+static int32_t deque_push(sched_deque_t *deque, sched_task_t *task) {
+  pthread_mutex_lock(&deque->mutex);
+  if (deque->size == deque->capacity) {
+    uint32_t capacity = deque->capacity ? deque->capacity * 2 : DEQUE_MIN;
+    sched_task_t *tasks = malloc(capacity * sizeof(sched_task_t));
+    if (!tasks) {
+      pthread_mutex_unlock(&deque->mutex);
+      return 1;
+    }
+    uint32_t i;
+    for (i = 0; i < deque->size; i++) {
+      tasks[i] = deque->tasks[(deque->top + i) % deque->capacity];
+    }
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->capacity = capacity;
+    deque->top = 0;
+  }
+  deque->tasks[(deque->top + deque->size) % deque->capacity] = *task;
+  __atomic_store_n(&deque->size, deque->size + 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&deque->mutex);
+  return 0;
+}
+
+/* @brief Takes a task from the bottom (owner) or the top (thief).
+ *
+ * @return 1 if a task was taken, else 0.
+ */
+static int32_t deque_take(sched_deque_t *deque, int32_t steal, sched_task_t *task) {
+  if (!__atomic_load_n(&deque->size, __ATOMIC_RELAXED)) {
+    return 0;
+  }
+  pthread_mutex_lock(&deque->mutex);
+  if (!deque->size) {
+    pthread_mutex_unlock(&deque->mutex);
+    return 0;
+  }
+  if (steal) {
+    *task = deque->tasks[deque->top];
+    deque->top = (deque->top + 1) % deque->capacity;
+  } else {
+    *task = deque->tasks[(deque->top + deque->size - 1) % deque->capacity];
+  }
+  __atomic_store_n(&deque->size, deque->size - 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&deque->mutex);
+  return 1;
+}
+
+/* @brief Finds the next task for a worker: its own deque first, then the
+ *        others', one priority at a time. */
+static int32_t find_task(sched_worker_t *worker, sched_task_t *task) {
+  uint32_t priority, i;
+  for (priority = 0; priority < SCHED_PRIORITIES; priority++) {
+    if (deque_take(&worker->deques[priority], 0, task)) {
+      return 1;
+    }
+    for (i = 1; i < scheduler.count; i++) {
+      sched_worker_t *victim = &scheduler.workers[(worker->index + i) % scheduler.count];
+      if (deque_take(&victim->deques[priority], 1, task)) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* @brief Runs a task unless its group was cancelled, and marks it done. */
+static void run_task(sched_task_t *task) {
+  if (!scheduler_cancelled(task->token)) {
+    task->fn(task->arg, task->token);
+  }
+  if (task->token && __atomic_sub_fetch(&task->token->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+    pthread_mutex_lock(&scheduler.mutex);
+    pthread_cond_broadcast(&scheduler.done);
+    pthread_mutex_unlock(&scheduler.mutex);
+  }
+}
+
+static void *worker_main(void *args) {
+  sched_worker_t *worker = args;
+  current_worker = worker;
+  trace_thread_name("worker");
+
+  while (1) {
+    sched_task_t task;
+    if (find_task(worker, &task)) {
+      __atomic_sub_fetch(&scheduler.queued, 1, __ATOMIC_RELAXED);
+      run_task(&task);
+      continue;
+    }
+    pthread_mutex_lock(&scheduler.mutex);
+    while (scheduler.running && !__atomic_load_n(&scheduler.queued, __ATOMIC_RELAXED)) {
+      pthread_cond_wait(&scheduler.work, &scheduler.mutex);
+    }
+    int32_t running = scheduler.running;
+    pthread_mutex_unlock(&scheduler.mutex);
+    if (!running) {
+      return NULL;
+    }
+  }
+}
+
+int32_t scheduler_start(uint32_t threads) {
+  scheduler.requested = threads;
+  scheduler.enabled = 1;
+  return 0;
+}
+
+/* @brief Starts the workers asked for by scheduler_start, once. If none
+ *        starts, the tasks run on the submitting thread. */
+static void start_workers(void) {
+  uint32_t threads = scheduler.requested;
+  if (!threads) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? cpus : 1;
+  }
+  if (threads > MAX_WORKERS) {
+    threads = MAX_WORKERS;
+  }
+  scheduler.workers = calloc(threads, sizeof(sched_worker_t));
+  if (!scheduler.workers) {
+    return;
+  }
+  scheduler.running = 1;
+  uint32_t i, priority;
+  for (i = 0; i < threads; i++) {
+    sched_worker_t *worker = &scheduler.workers[i];
+    worker->index = i;
+    for (priority = 0; priority < SCHED_PRIORITIES; priority++) {
+      pthread_mutex_init(&worker->deques[priority].mutex, NULL);
+    }
+  }
+  /* Set before the workers look at it. If some fail to start, the others
+   * still steal what is pushed to their deques. */
+  scheduler.count = threads;
+  uint32_t started = 0;
+  for (i = 0; i < threads; i++) {
+    if (pthread_create(&scheduler.workers[i].thread, NULL, &worker_main, &scheduler.workers[i])) {
+      fprintf(stderr, "Couldn't spawn worker thread: %s\n", strerror(errno));
+      break;
+    }
+    started++;
+  }
+  scheduler.started = started;
+  if (!started) {
+    scheduler.count = 0;
+    return;
+  }
+  debug("Started %u workers.\n", started);
+}
+
+int32_t scheduler_submit(sched_fn_t fn, void *arg, sched_token_t *token, sched_priority_t priority) {
+  sched_task_t task = { fn, arg, token };
+  if (token) {
+    __atomic_add_fetch(&token->pending, 1, __ATOMIC_ACQ_REL);
+  }
+  if (scheduler.enabled) {
+    pthread_once(&start_once, start_workers);
+  }
+  if (!scheduler.count) {
+    run_task(&task);
+    return 0;
+  }
+
+  sched_worker_t *worker = current_worker;
+  if (!worker) {
+    uint32_t next = __atomic_fetch_add(&scheduler.next, 1, __ATOMIC_RELAXED);
+    worker = &scheduler.workers[next % scheduler.count];
+  }
+  /* Counted before it is visible, so a worker taking it never sees 0. */
+  __atomic_add_fetch(&scheduler.queued, 1, __ATOMIC_RELAXED);
+  if (deque_push(&worker->deques[priority], &task)) {
+    __atomic_sub_fetch(&scheduler.queued, 1, __ATOMIC_RELAXED);
+    if (token) {
+      __atomic_sub_fetch(&token->pending, 1, __ATOMIC_ACQ_REL);
+    }
+    return 1;
+  }
+
+  pthread_mutex_lock(&scheduler.mutex);
+  pthread_cond_signal(&scheduler.work);
+  pthread_mutex_unlock(&scheduler.mutex);
+  return 0;
+}
+
+void scheduler_cancel(sched_token_t *token) {
+  __atomic_store_n(&token->cancelled, 1, __ATOMIC_RELEASE);
+}
+
+int32_t scheduler_cancelled(sched_token_t *token) {
+  return token && __atomic_load_n(&token->cancelled, __ATOMIC_ACQUIRE);
+}
+
+void scheduler_wait(sched_token_t *token) {
+  sched_task_t task;
+  /* A worker waiting on its own subtasks helps instead of blocking. */
+  while (current_worker && __atomic_load_n(&token->pending, __ATOMIC_ACQUIRE)) {
+    if (!find_task(current_worker, &task)) {
+      break;
+    }
+    __atomic_sub_fetch(&scheduler.queued, 1, __ATOMIC_RELAXED);
+    run_task(&task);
+  }
+  pthread_mutex_lock(&scheduler.mutex);
+  while (__atomic_load_n(&token->pending, __ATOMIC_ACQUIRE)) {
+    pthread_cond_wait(&scheduler.done, &scheduler.mutex);
+  }
+  pthread_mutex_unlock(&scheduler.mutex);
+}
+
+void scheduler_stop(void) {
+  if (!scheduler.count) {
+    return;
+  }
+  pthread_mutex_lock(&scheduler.mutex);
+  scheduler.running = 0;
+  pthread_cond_broadcast(&scheduler.work);
+  pthread_mutex_unlock(&scheduler.mutex);
+
+  uint32_t i, priority;
+  for (i = 0; i < scheduler.started; i++) {
+    pthread_join(scheduler.workers[i].thread, NULL);
+  }
+  for (i = 0; i < scheduler.count; i++) {
+    for (priority = 0; priority < SCHED_PRIORITIES; priority++) {
+      /* The tasks left are dropped, their groups must not wait for them. */
+      sched_task_t task;
+      while (deque_take(&scheduler.workers[i].deques[priority], 1, &task)) {
+        __atomic_sub_fetch(&scheduler.queued, 1, __ATOMIC_RELAXED);
+        if (task.token && __atomic_sub_fetch(&task.token->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+          pthread_mutex_lock(&scheduler.mutex);
+          pthread_cond_broadcast(&scheduler.done);
+          pthread_mutex_unlock(&scheduler.mutex);
+        }
+      }
+      free(scheduler.workers[i].deques[priority].tasks);
+      pthread_mutex_destroy(&scheduler.workers[i].deques[priority].mutex);
+    }
+  }
+  free(scheduler.workers);
+  scheduler.workers = NULL;
+  scheduler.count = 0;
+  scheduler.started = 0;
+}
@@ -0,0 +1,212 @@
+/** @file session.c
+ *
+ *  @brief This file contains the recording of a session (keys typed and
+ *         bytes received from the cmd) and its replay, to reproduce and
+ *         profile a slow session offline.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "session.h"
+
+/* @brief State of the recording. */
+static struct {
+  FILE *file;
+  pthread_mutex_t mutex;
+  uint64_t start;
+} record = { NULL, PTHREAD_MUTEX_INITIALIZER, 0 };
+
+/* @brief Arguments of the replay thread. */
+struct replay_params {
+  FILE *file;
+  int32_t fast;
+  int32_t frame_fd;
+  xcb_connection_t *connection;
+  xcb_window_t window;
+};
+
+/* @brief Returns a monotonic time in microseconds. */
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int32_t session_record_open(const char *path) {
+  record.file = fopen(path, "w");
+  if (!record.file) {
+    fprintf(stderr, "Couldn't open session file %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+  fputs(SESSION_HEADER, record.file);
+  record.start = now_us();
+  return 0;
+}
+
+void session_record_key(uint8_t keycode, uint16_t state) {
+  if (!record.file) {
+    return;
+  }
+  pthread_mutex_lock(&record.mutex);
+  fprintf(record.file, "K %" PRIu64 " %u %u\n", now_us() - record.start, keycode, state);
+  pthread_mutex_unlock(&record.mutex);
+}
+
+void session_record_frame(const char *data, size_t length) {
+  if (!record.file) {
+    return;
+  }
+  pthread_mutex_lock(&record.mutex);
+  fprintf(record.file, "F %" PRIu64 " %zu\n", now_us() - record.start, length);
+  fwrite(data, 1, length, record.file);
+  fputc('\n', record.file);
+  pthread_mutex_unlock(&record.mutex);
+}
+
+void session_record_close(void) {
+  if (!record.file) {
+    return;
+  }
+  pthread_mutex_lock(&record.mutex);
+  fclose(record.file);
+  record.file = NULL;
+  pthread_mutex_unlock(&record.mutex);
+}
+
+/* @brief Sends a key release to the window, as the X server would. */
+static void replay_key(struct replay_params *params, uint8_t keycode, uint16_t state) {
+  xcb_key_release_event_t event;
+  memset(&event, 0, sizeof(event));
+  event.response_type = XCB_KEY_RELEASE;
+  event.detail = keycode;
+  event.time = XCB_CURRENT_TIME;
+  event.root = xcb_setup_roots_iterator(xcb_get_setup(params->connection)).data->root;
+  event.event = params->window;
+  event.child = XCB_NONE;
+  event.state = state;
+  event.same_screen = 1;
+  xcb_send_event(params->connection, 0, params->window, XCB_EVENT_MASK_KEY_RELEASE, (const char *)&event);
+  xcb_flush(params->connection);
+}
+
+/* @brief Writes the whole buffer to the fd.
+ *
+ * @return 0 on success and 1 on failure.
+ */
+static int32_t replay_frame(int32_t fd, const char *data, size_t length) {
+  while (length) {
+    ssize_t ret = write(fd, data, length);
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return 1;
+    }
+    data += ret;
+    length -= ret;
+  }
+  return 0;
+}
+
+/* @brief Body of the replay thread. */
+static void *replay(void *args) {
+  struct replay_params *params = args;
+  uint64_t start = now_us();
+  char line[128];
+  char *data = NULL;
+  size_t data_size = 0;
+
+  while (fgets(line, sizeof(line), params->file)) {
+    char type;
+    uint64_t time;
+    uint64_t a, b = 0;
+    if (sscanf(line, "%c %" SCNu64 " %" SCNu64 " %" SCNu64, &type, &time, &a, &b) < 3) {
+      fprintf(stderr, "Invalid session record: %s", line);
+      break;
+    }
+
+    if (type == 'F') {
+      /* Read the bytes before waiting, so the timing isn't affected. */
+      if (a + 1 > data_size) {
+        data_size = a + 1;
+        char *tmp = realloc(data, data_size);
+        if (!tmp) {
+          break;
+        }
+        data = tmp;
+      }
+      if (fread(data, 1, a + 1, params->file) != a + 1) {
+        fprintf(stderr, "Truncated session file.\n");
+        break;
+      }
+    }
+
+    if (!params->fast) {
+      uint64_t now = now_us();
+      if (start + time > now) {
+        uint64_t delay = start + time - now;
+        struct timespec ts = { delay / 1000000, (delay % 1000000) * 1000 };
+        while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+      }
+    }
+
+    if (type == 'K') {
+      replay_key(params, a, b);
+    } else if (type == 'F') {
+      if (replay_frame(params->frame_fd, data, a)) {
+        break;
+      }
+    }
+  }
+
+  debug("Replay done.\n");
+  free(data);
+  fclose(params->file);
+  close(params->frame_fd);
+  free(params);
+  return NULL;
+}
+
+int32_t session_replay_start(const char *path, int32_t fast, int32_t frame_fd, xcb_connection_t *connection, xcb_window_t window) {
+  struct replay_params *params = malloc(sizeof(struct replay_params));
+  if (!params) {
+    return 1;
+  }
+  params->file = fopen(path, "r");
+  if (!params->file) {
+    fprintf(stderr, "Couldn't open session file %s: %s\n", path, strerror(errno));
+    free(params);
+    return 1;
+  }
+  char header[sizeof(SESSION_HEADER)];
+  if (!fgets(header, sizeof(header), params->file) || strcmp(header, SESSION_HEADER)) {
+    fprintf(stderr, "%s is not a lighthouse session.\n", path);
+    fclose(params->file);
+    free(params);
+    return 1;
+  }
+  params->fast = fast;
+  params->frame_fd = frame_fd;
+  params->connection = connection;
+  params->window = window;
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, &replay, params)) {
+    fprintf(stderr, "Couldn't spawn replay thread: %s\n", strerror(errno));
+    fclose(params->file);
+    free(params);
+    return 1;
+  }
+  pthread_detach(thread);
+  return 0;
+}
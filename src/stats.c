@@ -0,0 +1,184 @@
+/** @file stats.c
+ *
+ *  @brief This file contains the counters of a running lighthouse, printed to
+ *         stderr on SIGUSR1 to watch a resident instance.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "stats.h"
+#include "trace.h"
+
+/* @brief How to print each statistic, durations are shown in ms. */
+static const struct {
+  const char *name;
+  int32_t duration;
+} stat_info[STAT_COUNT] = {
+  { "queries sent", 0 },
+  { "frames received", 0 },
+  { "bytes read", 0 },
+  { "results parsed", 0 },
+  { "parse time", 1 },
+  { "renders", 0 },
+  { "render time", 1 },
+  { "rows drawn", 0 },
+  { "images decoded", 0 },
+  { "frames dropped", 0 },
+  { "desc cache hits", 0 },
+  { "desc cache misses", 0 },
+  { "regex cache hits", 0 },
+  { "regex cache misses", 0 },
+  { "last parse time", 1 },
+  { "last render time", 1 },
+  { "last backend latency", 1 },
+  { "last rows drawn", 0 }
+};
+
+static uint64_t stats[STAT_COUNT];
+static uint64_t query_time = 0;
+static int32_t from_child = -1;
+static int32_t to_child = -1;
+
+void stats_add(stat_t stat, uint64_t value) {
+  __atomic_fetch_add(&stats[stat], value, __ATOMIC_RELAXED);
+}
+
+void stats_set(stat_t stat, uint64_t value) {
+  __atomic_store_n(&stats[stat], value, __ATOMIC_RELAXED);
+}
+
+uint64_t stats_get(stat_t stat) {
+  return __atomic_load_n(&stats[stat], __ATOMIC_RELAXED);
+}
+
+void stats_query_sent(void) {
+  stats_add(STAT_QUERIES, 1);
+  __atomic_store_n(&query_time, trace_now(), __ATOMIC_RELAXED);
+}
+
+void stats_frame_received(uint64_t bytes, uint32_t results) {
+  stats_add(STAT_FRAMES, 1);
+  stats_add(STAT_BYTES_READ, bytes);
+  stats_add(STAT_RESULTS, results);
+  uint64_t sent = __atomic_exchange_n(&query_time, 0, __ATOMIC_RELAXED);
+  if (sent) {
+    stats_set(STAT_LAST_BACKEND_NS, trace_now() - sent);
+  }
+}
+
+/* @brief Returns the share of lookups that hit a cache, in percent. */
+static double hit_rate(stat_t hits, stat_t misses) {
+  uint64_t lookups = stats_get(hits) + stats_get(misses);
+  return lookups ? 100.0 * stats_get(hits) / lookups : 0;
+}
+
+/* @brief Returns the number of bytes waiting in a pipe, or -1. */
+static int64_t pipe_depth(int32_t fd) {
+  int pending;
+  if (fd < 0 || ioctl(fd, FIONREAD, &pending) == -1) {
+    return -1;
+  }
+  return pending;
+}
+
+/* @brief Returns the resident set size in kB, or -1. */
+static int64_t resident_size(void) {
+  long pages, resident;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (!statm) {
+    return -1;
+  }
+  int32_t ret = fscanf(statm, "%ld %ld", &pages, &resident);
+  fclose(statm);
+  if (ret != 2) {
+    return -1;
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void stats_dump(void) {
+  char buf[2048];
+  int32_t len = snprintf(buf, sizeof(buf), "lighthouse stats:\n");
+  int32_t i;
+  for (i = 0; i < STAT_COUNT && len < sizeof(buf); i++) {
+    uint64_t value = stats_get(i);
+    if (stat_info[i].duration) {
+      len += snprintf(buf + len, sizeof(buf) - len, "  %-22s %.3f ms\n", stat_info[i].name, value / 1e6);
+    } else {
+      len += snprintf(buf + len, sizeof(buf) - len, "  %-22s %llu\n", stat_info[i].name, (unsigned long long)value);
+    }
+  }
+  uint64_t frames = stats_get(STAT_FRAMES);
+  uint64_t renders = stats_get(STAT_RENDERS);
+  if (len < sizeof(buf)) {
+    len += snprintf(buf + len, sizeof(buf) - len,
+                    "  %-22s %.3f ms\n  %-22s %.3f ms\n",
+                    "mean parse time", frames ? stats_get(STAT_PARSE_NS) / 1e6 / frames : 0,
+                    "mean render time", renders ? stats_get(STAT_RENDER_NS) / 1e6 / renders : 0);
+  }
+  if (len < sizeof(buf)) {
+    len += snprintf(buf + len, sizeof(buf) - len,
+                    "  %-22s %.1f %%\n  %-22s %.1f %%\n",
+                    "desc cache hit rate", hit_rate(STAT_DESC_CACHE_HITS, STAT_DESC_CACHE_MISSES),
+                    "regex cache hit rate", hit_rate(STAT_DFA_CACHE_HITS, STAT_DFA_CACHE_MISSES));
+  }
+  if (len < sizeof(buf)) {
+    len += snprintf(buf + len, sizeof(buf) - len,
+                    "  %-22s %lld kB\n  %-22s %lld bytes\n  %-22s %lld bytes\n",
+                    "resident size", (long long)resident_size(),
+                    "pending from cmd", (long long)pipe_depth(from_child),
+                    "pending to cmd", (long long)pipe_depth(to_child));
+  }
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  if (len < sizeof(buf)) {
+    len += snprintf(buf + len, sizeof(buf) - len,
+                    "  %-22s %zu kB (%zu kB in use, %zu kB mmapped)\n",
+                    "malloc arena", info.arena / 1024, info.uordblks / 1024, info.hblkhd / 1024);
+  }
+#endif
+  if (len > sizeof(buf)) {
+    len = sizeof(buf);
+  }
+  /* One write, so the dump isn't interleaved with other output. */
+  if (write(STDERR_FILENO, buf, len) == -1) {
+    return;
+  }
+}
+
+/* @brief Waits for SIGUSR1 and dumps the statistics. */
+static void *stats_signal_thread(void *args) {
+  sigset_t *set = args;
+  int sig;
+  while (!sigwait(set, &sig)) {
+    stats_dump();
+  }
+  return NULL;
+}
+
+int32_t stats_start(int32_t from_child_fd, int32_t to_child_fd) {
+  static sigset_t set;
+  from_child = from_child_fd;
+  to_child = to_child_fd;
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, &stats_signal_thread, &set)) {
+    fprintf(stderr, "Couldn't spawn stats thread: %s\n", strerror(errno));
+    return 1;
+  }
+  pthread_detach(thread);
+  return 0;
+}
@@ -0,0 +1,194 @@
+/** @file trace.c
+ *
+ *  @brief This file contains the tracing of internal spans, exported as
+ *         Chrome trace-event JSON.
+ *
+ *  Each thread writes its spans into its own ring buffer, without locks.
+ *  The buffers are chained in a list (lock-free push) so they can be dumped
+ *  at exit or on SIGUSR2.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "trace.h"
+
+/* @brief Spans kept per thread, the oldest are overwritten. */
+#define TRACE_CAPACITY    (64 * 1024)
+
+/* @brief A recorded span. seq is the index it was written at, used by the
+ *        dump to skip the spans overwritten while it reads them. */
+typedef struct {
+  uint64_t seq;
+  uint64_t begin;
+  uint64_t end;
+  uint32_t span;
+  uint32_t arg;
+} trace_event_t;
+
+/* @brief The buffer of a thread. */
+struct trace_buffer {
+  struct trace_buffer *next;
+  const char *name;
+  uint32_t tid;
+  uint64_t head; /* Number of spans written, only the owner writes it. */
+  trace_event_t events[TRACE_CAPACITY];
+};
+
+static const char *trace_names[TRACE_SPAN_COUNT] = {
+  "event wait",
+  "key",
+  "child write",
+  "read",
+  "parse",
+  "layout row",
+  "image decode",
+  "flush"
+};
+
+int32_t trace_enabled = 0;
+
+static const char *trace_path = NULL;
+static struct trace_buffer *trace_buffers = NULL;
+static __thread struct trace_buffer *local_buffer = NULL;
+static pthread_mutex_t dump_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t trace_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* @brief Returns the buffer of the calling thread, registering it the first
+ *        time (the only allocation of the tracer). */
+static struct trace_buffer *get_local_buffer(void) {
+  if (local_buffer) {
+    return local_buffer;
+  }
+  struct trace_buffer *buffer = calloc(1, sizeof(struct trace_buffer));
+  if (!buffer) {
+    return NULL;
+  }
+  buffer->tid = syscall(SYS_gettid);
+  buffer->next = __atomic_load_n(&trace_buffers, __ATOMIC_ACQUIRE);
+  while (!__atomic_compare_exchange_n(&trace_buffers, &buffer->next, buffer, 1,
+                                      __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+  local_buffer = buffer;
+  return buffer;
+}
+
+void trace_record(trace_span_t span, uint64_t begin, uint64_t end, uint32_t arg) {
+  struct trace_buffer *buffer = get_local_buffer();
+  if (!buffer) {
+    return;
+  }
+  uint64_t head = buffer->head;
+  trace_event_t *event = &buffer->events[head % TRACE_CAPACITY];
+  __atomic_store_n(&event->seq, UINT64_MAX, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  event->begin = begin;
+  event->end = end;
+  event->span = span;
+  event->arg = arg;
+  __atomic_store_n(&event->seq, head, __ATOMIC_RELEASE);
+  __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_thread_name(const char *name) {
+  if (!trace_enabled) {
+    return;
+  }
+  struct trace_buffer *buffer = get_local_buffer();
+  if (buffer) {
+    __atomic_store_n(&buffer->name, name, __ATOMIC_RELEASE);
+  }
+}
+
+int32_t trace_dump(void) {
+  if (!trace_path) {
+    return 1;
+  }
+  pthread_mutex_lock(&dump_mutex);
+  FILE *file = fopen(trace_path, "w");
+  if (!file) {
+    fprintf(stderr, "Couldn't write trace %s: %s\n", trace_path, strerror(errno));
+    pthread_mutex_unlock(&dump_mutex);
+    return 1;
+  }
+
+  uint32_t pid = getpid();
+  int32_t first = 1;
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for (struct trace_buffer *buffer = __atomic_load_n(&trace_buffers, __ATOMIC_ACQUIRE);
+       buffer; buffer = buffer->next) {
+    const char *name = __atomic_load_n(&buffer->name, __ATOMIC_ACQUIRE);
+    if (name) {
+      fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+              first ? "" : ",\n", pid, buffer->tid, name);
+      first = 0;
+    }
+    uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    uint64_t seq = head > TRACE_CAPACITY ? head - TRACE_CAPACITY : 0;
+    for (; seq < head; seq++) {
+      trace_event_t *slot = &buffer->events[seq % TRACE_CAPACITY];
+      trace_event_t event = *slot;
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq || event.seq != seq) {
+        /* Overwritten while we were reading it. */
+        continue;
+      }
+      fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"arg\":%u}}",
+              first ? "" : ",\n", trace_names[event.span], pid, buffer->tid,
+              event.begin / 1000.0, (event.end - event.begin) / 1000.0, event.arg);
+      first = 0;
+    }
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+  pthread_mutex_unlock(&dump_mutex);
+  return 0;
+}
+
+static void trace_dump_at_exit(void) {
+  trace_dump();
+}
+
+/* @brief Waits for SIGUSR2 and dumps the trace, signals are blocked in every
+ *        other thread so they all end up here. */
+static void *trace_signal_thread(void *args) {
+  sigset_t *set = args;
+  int sig;
+  while (!sigwait(set, &sig)) {
+    debug("Dumping the trace to %s.\n", trace_path);
+    trace_dump();
+  }
+  return NULL;
+}
+
+int32_t trace_start(const char *path) {
+  static sigset_t set;
+  trace_path = path;
+  trace_enabled = 1;
+  atexit(trace_dump_at_exit);
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, &trace_signal_thread, &set)) {
+    fprintf(stderr, "Couldn't spawn trace thread: %s\n", strerror(errno));
+    return 1;
+  }
+  pthread_detach(thread);
+  return 0;
+}